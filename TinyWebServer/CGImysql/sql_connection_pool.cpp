@@ -10,10 +10,17 @@
 
 using namespace std;
 
+//与SQL_STATEMENT一一对应
+static const char *const statement_sql[STMT_COUNT] = {
+	"SELECT passwd FROM user WHERE username = ?",
+	"INSERT INTO user(username, passwd) VALUES(?, ?)",
+};
+
 connection_pool::connection_pool()//构造函数，初始化连接数为0
 {
 	m_CurConn = 0;
 	m_FreeConn = 0;
+	m_MaxConn = 0;
 }
 
 connection_pool *connection_pool::GetInstance()//使用局部静态变量实现单例模式，返回连接池的唯一实例。
@@ -27,7 +34,7 @@ void connection_pool::init(string url, string User, string PassWord, string DBNa
 {
 	//保存连接参数
 	m_url = url;
-	m_Port = Port;
+	m_Port = to_string(Port);
 	m_User = User;
 	m_PassWord = PassWord;
 	m_DatabaseName = DBName;
@@ -36,22 +43,17 @@ void connection_pool::init(string url, string User, string PassWord, string DBNa
 	//创建指定数量的数据库连接
 	for (int i = 0; i < MaxConn; i++)
 	{
-		MYSQL *con = nullptr;
-		con = mysql_init(con);
-
-		if (con == nullptr)
-		{
-			LOG_ERROR("MySQL Error");
-			exit(1);
-		}
-		con = mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DBName.c_str(), Port, nullptr, 0);
+		MYSQL *con = new MYSQL;
 
-		if (con == nullptr)
+		if (!Connect(con))
 		{
 			LOG_ERROR("MySQL Error");
 			exit(1);
 		}
 		connList.push_back(con);
+		statement_set &set = m_statements[con];
+		memset(set.stmts, 0, sizeof(set.stmts));
+		set.connected = true;
 		++m_FreeConn;
 	}
 
@@ -66,7 +68,7 @@ MYSQL *connection_pool::GetConnection()
 {
 	MYSQL *con = NULL;
 
-	if (0 == connList.size())
+	if (0 == m_MaxConn)// 连接池没有可用的连接；连接都被占用时在信号量上等待归还
 		return NULL;
 	
     //使用信号量等待可用连接，然后加锁从连接池列表头部取出一个连接，更新计数。
@@ -113,7 +115,9 @@ void connection_pool::DestroyPool()//销毁连接池，关闭所有连接并清
 		for (it = connList.begin(); it != connList.end(); ++it)
 		{
 			MYSQL *con = *it;
+			CloseStatements(m_statements[con]);
 			mysql_close(con);// 关闭数据库连接
+			delete con;
 		}
 		m_CurConn = 0;
 		m_FreeConn = 0;
@@ -123,6 +127,82 @@ void connection_pool::DestroyPool()//销毁连接池，关闭所有连接并清
 	lock.unlock(); // 解锁
 }
 
+bool connection_pool::ConnectionLost(MYSQL_STMT *stmt)
+{
+	unsigned int err = mysql_stmt_errno(stmt);
+	return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+}
+
+void connection_pool::CloseStatements(statement_set &set)
+{
+	for (int i = 0; i < STMT_COUNT; ++i)
+	{
+		if (set.stmts[i])
+			mysql_stmt_close(set.stmts[i]);
+		set.stmts[i] = NULL;
+	}
+}
+
+//mysql_init传入连接池分配的句柄时，mysql_close只释放内部资源，句柄可以再次初始化，m_statements与connList中的地址保持有效
+bool connection_pool::Connect(MYSQL *con)
+{
+	if (mysql_init(con) == NULL)
+		return false;
+	return mysql_real_connect(con, m_url.c_str(), m_User.c_str(), m_PassWord.c_str(), m_DatabaseName.c_str(),
+							  atoi(m_Port.c_str()), NULL, 0) != NULL;
+}
+
+//不依赖已弃用的MYSQL_OPT_RECONNECT：语句执行时发现连接断开，由持有连接的线程显式重连，
+//旧连接上准备的语句随之失效，全部关闭，之后取用时在新连接上重新准备
+bool connection_pool::Reconnect(MYSQL *con)
+{
+	map<MYSQL *, statement_set>::iterator it = m_statements.find(con);
+	if (it == m_statements.end())
+		return false;
+	CloseStatements(it->second);
+	mysql_close(con);
+	it->second.connected = Connect(con);
+	if (!it->second.connected)
+	{
+		LOG_ERROR("MySQL reconnect failed: %s", mysql_error(con));
+		return false;
+	}
+	LOG_INFO("%s", "MySQL connection lost, reconnected");
+	return true;
+}
+
+//语句在连接上首次取用时准备，之后反复执行，不再每次往返服务器准备与关闭
+MYSQL_STMT *connection_pool::GetStatement(MYSQL *con, int id)
+{
+	if (NULL == con || id < 0 || id >= STMT_COUNT)
+		return NULL;
+	map<MYSQL *, statement_set>::iterator it = m_statements.find(con);
+	if (it == m_statements.end())
+		return NULL;
+	statement_set &set = it->second;
+	if (!set.connected && !Reconnect(con))
+		return NULL;
+
+	MYSQL_STMT *&stmt = set.stmts[id];
+	if (!stmt)
+	{
+		stmt = mysql_stmt_init(con);
+		if (!stmt)
+		{
+			LOG_ERROR("mysql_stmt_init failed: %s", mysql_error(con));
+			return NULL;
+		}
+		if (mysql_stmt_prepare(stmt, statement_sql[id], strlen(statement_sql[id])) != 0)
+		{
+			LOG_ERROR("mysql_stmt_prepare failed: %s", mysql_stmt_error(stmt));
+			set.connected = !ConnectionLost(stmt);
+			mysql_stmt_close(stmt);
+			stmt = NULL;
+		}
+	}
+	return stmt;
+}
+
 //返回当前空闲的连接数
 int connection_pool::GetFreeConn()
 {
@@ -4,15 +4,25 @@
 #include <stdio.h>
 #include <list>
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
 #include <error.h>
 #include <string.h>
 #include <iostream>
 #include <string>
+#include <map>
 #include "../lock/locker.h"
 #include "../log/log.h"
 
 using namespace std;
 
+//每个连接上预先准备的语句，语句文本见sql_connection_pool.cpp
+enum SQL_STATEMENT
+{
+	STMT_SELECT_PASSWD = 0,// 按用户名查询密码
+	STMT_INSERT_USER,	   // 插入新用户
+	STMT_COUNT
+};
+
 class connection_pool//数据库连接池类，用于管理多个数据库连接，避免频繁建立和关闭连接的开销。
 {
 public:
@@ -20,6 +30,9 @@ public:
 	bool ReleaseConnection(MYSQL *conn); //释放连接，将其放回连接池
 	int GetFreeConn();					 //获取当前空闲连接数
 	void DestroyPool();					 //销毁所有连接
+	MYSQL_STMT *GetStatement(MYSQL *conn, int id); //取得连接上准备好的语句，首次取用或连接重连后才准备，失败返回空
+	bool Reconnect(MYSQL *conn);		 //连接断开后关闭它的语句并在同一个句柄上重新连接
+	static bool ConnectionLost(MYSQL_STMT *stmt);  //语句上次执行失败是因为连接断开
 
 	//单例模式,获取连接池实例
 	static connection_pool *GetInstance();
@@ -37,6 +50,16 @@ private:
 	list<MYSQL *> connList; //连接池,存储空闲连接的列表（实际是链表）
 	sem reserve;//信号量，用于管理连接资源
 
+	//一个连接上准备好的语句，连接重连后全部失效
+	struct statement_set
+	{
+		MYSQL_STMT *stmts[STMT_COUNT];
+		bool connected; //为假表示上次重连失败或准备语句时发现连接断开，下次取语句前先重连
+	};
+	map<MYSQL *, statement_set> m_statements; //init之后不再增删，每一项只由当前持有该连接的线程访问
+	void CloseStatements(statement_set &set);
+	bool Connect(MYSQL *con); //初始化句柄并连接数据库，句柄由连接池分配，mysql_close不释放它，重连后地址不变
+
 public:
 	string m_url;			 //主机地址
 	string m_Port;		 //数据库端口号
@@ -53,6 +76,9 @@ class connectionRAII{//这是一个资源获取即初始化的类，用于自动
 public:
 	connectionRAII(MYSQL **con, connection_pool *connPool);//从连接池获取一个连接
 	~connectionRAII();//将连接释放回连接池
+	MYSQL *connection() const { return conRAII; }
+	MYSQL_STMT *statement(int id) { return poolRAII->GetStatement(conRAII, id); }//随连接取得的预处理语句，用完不关闭，有结果集时调用mysql_stmt_free_result
+	bool reconnect() { return poolRAII->Reconnect(conRAII); }//语句执行时连接已断开，重连后再取语句
 	
 private:
 	MYSQL *conRAII;//数据库连接
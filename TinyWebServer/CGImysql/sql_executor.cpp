@@ -0,0 +1,53 @@
+#include "sql_executor.h"
+
+void sql_executor::init(connection_pool *connPool, int thread_number)
+{
+    m_connPool = connPool;
+    if (thread_number <= 0)
+        thread_number = 1;
+    m_threads.reserve(thread_number);
+    for (int i = 0; i < thread_number; ++i)
+        m_threads.emplace_back([this]() { this->run(); });
+}
+
+sql_executor::~sql_executor()
+{
+    for (auto &t : m_threads)
+    {
+        if (t.joinable())
+            t.detach();
+    }
+}
+
+void sql_executor::submit(sql_task *task)
+{
+    m_queuelocker.lock();
+    m_tasks.push_back(task);
+    m_queuelocker.unlock();
+    m_queuestat.post();
+}
+
+void sql_executor::run()
+{
+    while (true)
+    {
+        m_queuestat.wait();
+        m_queuelocker.lock();
+        if (m_tasks.empty())
+        {
+            m_queuelocker.unlock();
+            continue;
+        }
+        sql_task *task = m_tasks.front();
+        m_tasks.pop_front();
+        m_queuelocker.unlock();
+
+        //连接在任务结束时归还，任务的完成通知（如恢复挂起的请求）在归还之前发出
+        {
+            MYSQL *mysql = nullptr;
+            connectionRAII mysqlcon(&mysql, m_connPool);
+            task->run(mysqlcon);
+        }
+        delete task;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef SQL_EXECUTOR_H
+#define SQL_EXECUTOR_H
+
+#include <list>
+#include <thread>
+#include <vector>
+#include "sql_connection_pool.h"
+
+//数据库任务：在执行线程上运行，con持有从连接池取得的连接（取不到时为空）及连接上准备好的语句；运行结束后由执行器释放
+class sql_task
+{
+public:
+    virtual ~sql_task() {}
+    virtual void run(connectionRAII &con) = 0;
+};
+
+//数据库执行器：查询在自己的线程上执行，工作线程提交任务后立即返回处理其他连接，
+//数据库变慢时只有等待查询结果的请求变慢，静态文件与内存中可判断的请求不受影响
+class sql_executor
+{
+public:
+    static sql_executor *get_instance()//获取执行器的单例实例
+    {
+        static sql_executor instance;
+        return &instance;
+    }
+
+    //thread_number个执行线程，每个任务执行期间占用一个连接，一般与连接池大小相同
+    void init(connection_pool *connPool, int thread_number);
+    void submit(sql_task *task);
+
+private:
+    sql_executor() : m_connPool(nullptr) {}
+    ~sql_executor();
+    void run();
+
+private:
+    connection_pool *m_connPool;
+    std::vector<std::thread> m_threads;
+    std::list<sql_task *> m_tasks; //等待执行的任务
+    locker m_queuelocker;          //保护任务队列的互斥锁
+    sem m_queuestat;               //队列中的任务数
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gzip_stream.h"
+
+int gzip_stream::m_level = 6;
+long gzip_stream::m_budget_ns = 500 * 1000000L;
+std::mutex gzip_stream::m_mutex;
+std::vector<gzip_stream *> gzip_stream::m_idle;
+int gzip_stream::m_count = 0;
+std::atomic<long> gzip_stream::m_spent_ns(0);
+std::atomic<long> gzip_stream::m_window(0);
+
+static long thread_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+gzip_stream *gzip_stream::acquire(const char *data, int fd, size_t len)
+{
+    gzip_stream *stream = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle.empty())
+        {
+            stream = m_idle.back();
+            m_idle.pop_back();
+        }
+        else if (m_count < MAX_STREAMS)
+        {
+            ++m_count;
+            stream = new gzip_stream;
+        }
+    }
+    if (!stream)
+        return nullptr;
+    if (!stream->m_ready || deflateReset(&stream->m_zs) != Z_OK)
+    {
+        stream->close();
+        return nullptr;
+    }
+    stream->m_data = data;
+    stream->m_fd = fd;
+    stream->m_len = len;
+    stream->m_offset = 0;
+    stream->m_zs.avail_in = 0;// 上一个响应可能中途结束，留下未压缩完的输入
+    return stream;
+}
+
+void gzip_stream::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idle.push_back(this);
+}
+
+gzip_stream::gzip_stream() : m_data(nullptr), m_fd(-1), m_len(0), m_offset(0)
+{
+    memset(&m_zs, 0, sizeof(m_zs));
+    m_ready = deflateInit2(&m_zs, m_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;// windowBits加16输出gzip格式
+}
+
+gzip_stream::~gzip_stream()
+{
+    if (m_ready)
+        deflateEnd(&m_zs);
+}
+
+//按秒统计：进入新的一秒时清零，上一秒的超额不延续到下一秒
+bool gzip_stream::admit()
+{
+    if (m_level <= 0)
+        return false;
+    if (m_budget_ns <= 0)
+        return true;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    long window = m_window.load(std::memory_order_relaxed);
+    if (window != ts.tv_sec && m_window.compare_exchange_strong(window, ts.tv_sec))
+        m_spent_ns = 0;
+    return m_spent_ns.load(std::memory_order_relaxed) < m_budget_ns;
+}
+
+//输出写满CHUNK_SIZE或压缩结束时返回；输入用完时从内存或文件补充下一块，最后一块交给deflate时改为Z_FINISH
+bool gzip_stream::next(std::string &out, bool &done)
+{
+    long begin = thread_cpu_ns();
+    size_t start = out.size();
+    out.resize(start + CHUNK_SIZE);
+    m_zs.next_out = (Bytef *)&out[start];
+    m_zs.avail_out = CHUNK_SIZE;
+    int ret = Z_OK;
+    bool ok = true;
+    while (m_zs.avail_out > 0)
+    {
+        if (m_zs.avail_in == 0 && m_offset < m_len)
+        {
+            size_t want = m_len - m_offset < (size_t)CHUNK_SIZE ? m_len - m_offset : CHUNK_SIZE;
+            if (m_data)
+                m_zs.next_in = (Bytef *)(m_data + m_offset);
+            else
+            {
+                //sendfile方式没有映射，按块从文件读入，不需要整个文件大小的输入缓冲
+                ssize_t n = pread(m_fd, m_in, want, m_offset);
+                if (n <= 0)
+                {
+                    ok = false;
+                    break;
+                }
+                want = n;
+                m_zs.next_in = (Bytef *)m_in;
+            }
+            m_zs.avail_in = want;
+            m_offset += want;
+        }
+        ret = deflate(&m_zs, m_offset == m_len ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR)
+        {
+            ok = false;
+            break;
+        }
+        if (ret == Z_STREAM_END)
+            break;
+    }
+    out.resize(start + CHUNK_SIZE - m_zs.avail_out);
+    done = ret == Z_STREAM_END;
+
+    m_spent_ns += thread_cpu_ns() - begin;
+    return ok;
+}
@@ -0,0 +1,53 @@
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+#include <zlib.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../http/body_stream.h"
+
+//即时gzip压缩的响应体：每次发送完上一段后再压缩出下一段（约16KB），不在内存中保存整个压缩后的响应体。
+//压缩器放在空闲列表中复用，每个响应deflateReset，不为每个请求分配zlib的内部状态（约256KB）；
+//同时压缩的响应数有上限，全部线程每秒用于压缩的CPU时间超出预算时也不再压缩，直接发送原内容
+class gzip_stream : public body_stream
+{
+public:
+    //取一个空闲的压缩器开始压缩len字节：data非空时压缩内存中的内容，否则按块从fd读取；没有可用的压缩器时返回空
+    static gzip_stream *acquire(const char *data, int fd, size_t len);
+
+    bool next(std::string &out, bool &done) override;// 压缩出不超过CHUNK_SIZE字节的下一段输出
+    void close() override;// 归还到空闲列表
+
+    static bool admit();// 压缩已开启且本秒的CPU预算还有剩余
+
+public:
+    static int m_level;// 压缩级别1-9，0表示不做即时压缩
+    static long m_budget_ns;// 每秒全部线程可用于压缩的CPU时间，0为不限
+
+private:
+    gzip_stream();
+    ~gzip_stream();
+
+private:
+    static const int CHUNK_SIZE = 16 * 1024;// 每段输出的最大长度，也是从文件读取的粒度
+    static const int MAX_STREAMS = 64;// 同时压缩的响应数上限，超出时发送原内容
+    z_stream m_zs;
+    bool m_ready;// deflateInit2是否成功
+    const char *m_data;// mmap方式下的文件内容，sendfile方式为空
+    int m_fd;// sendfile方式下读取的fd
+    size_t m_len;// 输入的总长度
+    size_t m_offset;// 已交给deflate的输入长度
+    char m_in[CHUNK_SIZE];// sendfile方式下从fd读入的文件内容
+
+    static std::mutex m_mutex;// 保护空闲列表
+    static std::vector<gzip_stream *> m_idle;
+    static int m_count;// 已创建的压缩器数
+    static std::atomic<long> m_spent_ns;// 当前一秒内已用于压缩的CPU时间
+    static std::atomic<long> m_window;// 当前统计的秒数
+};
+
+#endif
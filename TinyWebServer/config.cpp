@@ -30,11 +30,38 @@ Config::Config(){
 
     //并发模型,默认是proactor
     actor_model = 0;
+
+    //子反应堆数量,默认0,即单反应堆
+    reactor_num = 0;
+
+    //I/O后端,默认epoll
+    io_backend = 0;
+
+    //单个请求的上限(KB),默认64
+    max_request = 64;
+
+    //静态文件发送方式,默认sendfile
+    zero_copy = 1;
+
+    //预压缩静态文件,默认开启
+    precompress = 1;
+
+    //即时压缩级别,默认6
+    compress_level = 6;
+
+    //即时压缩每秒的CPU预算(毫秒),默认500
+    compress_budget = 500;
+
+    //缓存策略规则文件,默认为空,使用内置规则
+    cache_rules = "";
+
+    //接受HTTP/2(h2c),默认开启
+    http2 = 1;
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:r:i:b:z:e:g:u:k:v:";
     while ((opt = getopt(argc, argv, str)) != -1)
     {
         switch (opt)
@@ -79,6 +106,51 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'r':
+        {
+            reactor_num = atoi(optarg);
+            break;
+        }
+        case 'i':
+        {
+            io_backend = atoi(optarg);
+            break;
+        }
+        case 'b':
+        {
+            max_request = atoi(optarg);
+            break;
+        }
+        case 'z':
+        {
+            zero_copy = atoi(optarg);
+            break;
+        }
+        case 'e':
+        {
+            precompress = atoi(optarg);
+            break;
+        }
+        case 'g':
+        {
+            compress_level = atoi(optarg);
+            break;
+        }
+        case 'u':
+        {
+            compress_budget = atoi(optarg);
+            break;
+        }
+        case 'k':
+        {
+            cache_rules = optarg;
+            break;
+        }
+        case 'v':
+        {
+            http2 = atoi(optarg);
+            break;
+        }
         default:
             break;
         }
@@ -42,6 +42,33 @@ public:
 
     //并发模型选择
     int actor_model;
+
+    //子反应堆数量
+    int reactor_num;
+
+    //I/O后端选择
+    int io_backend;
+
+    //单个请求（请求行、头部与请求体）的上限，单位KB
+    int max_request;
+
+    //静态文件发送方式
+    int zero_copy;
+
+    //启动时预压缩静态文件
+    int precompress;
+
+    //即时压缩级别
+    int compress_level;
+
+    //即时压缩每秒的CPU预算，单位毫秒
+    int compress_budget;
+
+    //静态文件缓存策略规则文件
+    string cache_rules;
+
+    //是否接受HTTP/2（h2c）
+    int http2;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,556 @@
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <zlib.h>
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "file_cache.h"
+#include "mime_types.h"
+
+//文件内容、权限、目录结构变化时都要摘下缓存项
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                   IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF;
+
+//只压缩文本类文件，gif/jpg/mp4等本身已压缩，再压缩只会浪费CPU
+static const char *COMPRESSIBLE[] = {".html", ".htm", ".css", ".js", ".json", ".txt", ".xml", ".svg", ".ico"};
+static const off_t MIN_COMPRESS_SIZE = 256;// 小于一个报文的文件压缩收益不抵响应头的开销
+static const off_t MAX_COMPRESS_SIZE = 16 * 1024 * 1024;// 压缩版本常驻内存，过大的文件不压缩
+
+static bool compressible(const std::string &path)
+{
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+        return false;
+    for (const char *ext : COMPRESSIBLE)
+    {
+        if (strcasecmp(path.c_str() + dot, ext) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool gzip_compress(const char *data, size_t len, std::string &out)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)// windowBits加16输出gzip格式
+        return false;
+    out.resize(deflateBound(&zs, len));
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+static bool brotli_compress(const char *data, size_t len, std::string &out)
+{
+#ifdef USE_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(len);
+    if (size == 0)
+        return false;
+    out.resize(size);
+    //文件修改后由压缩线程重新压缩，不使用最慢的11级，压缩版本能尽快替换原内容
+    if (!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, (const uint8_t *)data, &size, (uint8_t *)&out[0]))
+        return false;
+    out.resize(size);
+    return true;
+#else
+    return false;
+#endif
+}
+
+static const char *ENCODING_NAMES[file_entry::ENCODING_COUNT] = {nullptr, "gzip", "br"};
+
+//生成一种编码的ETag与完整的响应头，Last-Modified各编码相同
+static void make_header(file_entry *entry, int encoding, long long length)
+{
+    file_entry::variant &v = entry->variants[encoding];
+    char etag[64];
+    file_cache::make_etag(entry->st, encoding == file_entry::IDENTITY ? nullptr : ENCODING_NAMES[encoding], etag, sizeof(etag));
+    v.etag = etag;
+
+    if (entry->last_modified.empty())
+    {
+        char modified[64];
+        struct tm tm;
+        gmtime_r(&entry->st.st_mtime, &tm);
+        strftime(modified, sizeof(modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        entry->last_modified = modified;
+    }
+
+    //缓存策略的长度由规则文件决定，头部在string中拼接，不受定长缓冲区截断
+    char status[64];
+    snprintf(status, sizeof(status), "HTTP/1.1 200 OK\r\nContent-Length:%lld\r\n", length);
+    std::string header = status;
+    v.fields = header.size();
+    if (encoding != file_entry::IDENTITY)
+        header.append("Content-Encoding:").append(ENCODING_NAMES[encoding]).append("\r\n");
+    if (entry->text)
+        header += "Vary:Accept-Encoding\r\n";// 同一URL的响应随Accept-Encoding变化，缓存代理需要区分
+    //带Range的请求总是按原内容响应，压缩版本也声明支持范围请求
+    header.append("ETag:").append(etag).append("\r\nLast-Modified:").append(entry->last_modified);
+    header.append("\r\nAccept-Ranges:bytes\r\n").append(entry->policy);
+    v.header.swap(header);
+}
+
+void file_cache::make_etag(const struct stat &st, const char *suffix, char *buf, int size)
+{
+    long long mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    snprintf(buf, size, "\"%llx-%llx-%llx%s%s\"", (unsigned long long)st.st_ino, (unsigned long long)st.st_size,
+             (unsigned long long)mtime, suffix ? "-" : "", suffix ? suffix : "");
+}
+
+//没有规则文件时：图片、字体与音视频长期缓存，页面只缓存一分钟
+static const char *DEFAULT_RULES[][2] = {
+    {"*.html", "public, max-age=60"},
+    {"*.htm", "public, max-age=60"},
+    {"*.gif", "public, max-age=31536000, immutable"},
+    {"*.jpg", "public, max-age=31536000, immutable"},
+    {"*.jpeg", "public, max-age=31536000, immutable"},
+    {"*.png", "public, max-age=31536000, immutable"},
+    {"*.webp", "public, max-age=31536000, immutable"},
+    {"*.ico", "public, max-age=31536000, immutable"},
+    {"*.svg", "public, max-age=31536000, immutable"},
+    {"*.woff2", "public, max-age=31536000, immutable"},
+    {"*.mp4", "public, max-age=31536000, immutable"},
+};
+
+file_cache::file_cache() : m_map(false), m_precompress(false), m_inotifyfd(-1), m_background(false)
+{
+}
+
+//规则文件每行一条："URL模式 Cache-Control的取值"，如"*.gif public, max-age=31536000, immutable"，#开头为注释
+bool file_cache::load_rules(const char *file)
+{
+    std::vector<std::pair<std::string, std::string>> rules;
+    if (!file || !*file)
+    {
+        for (auto &rule : DEFAULT_RULES)
+            rules.emplace_back(rule[0], rule[1]);
+    }
+    else
+    {
+        FILE *fp = fopen(file, "r");
+        if (!fp)
+            return false;
+        char *line = nullptr;// getline按行长度分配，较长的Cache-Control取值不会被拆成两条规则
+        size_t size = 0;
+        while (getline(&line, &size, fp) != -1)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            char *pattern = line + strspn(line, " \t");
+            if (*pattern == '\0' || *pattern == '#')
+                continue;
+            char *value = pattern + strcspn(pattern, " \t");
+            if (*value)
+                *value++ = '\0';
+            value += strspn(value, " \t");
+            rules.emplace_back(pattern, value);
+        }
+        free(line);
+        fclose(fp);
+    }
+
+    m_rules.clear();
+    for (auto &rule : rules)
+    {
+        const char *max_age = strstr(rule.second.c_str(), "max-age=");
+        m_rules.push_back({rule.first, rule.second, max_age ? atol(max_age + 8) : -1});
+    }
+    return true;
+}
+
+bool file_cache::init(const char *root, bool map, bool precompress)
+{
+    m_root = root;
+    m_map = map;
+    m_precompress = precompress;
+
+    m_inotifyfd = inotify_init1(IN_CLOEXEC);
+    if (m_inotifyfd < 0)
+        return false;
+    add_watch(m_root);
+    //先建立监视再预加载，预加载期间被修改的文件也会被摘下
+    if (m_precompress)
+        preload(m_root);
+    m_background = true;
+
+    //监视线程阻塞在read上，压缩线程在队列上等待，进程退出时随之结束
+    std::thread(&file_cache::watch_loop, this).detach();
+    if (m_precompress)
+        std::thread(&file_cache::compress_loop, this).detach();
+    return true;
+}
+
+file_entry *file_cache::create(const std::string &url, const std::string &path)
+{
+    file_entry *entry = new file_entry;
+    entry->url = url;
+    entry->path = path;
+    entry->fd = -1;
+    entry->address = nullptr;
+    entry->state = file_entry::LOADING;
+    entry->error = 0;
+    entry->text = false;
+    entry->refs = 1;
+    return entry;
+}
+
+file_entry *file_cache::acquire(const char *url, int &error)
+{
+    std::string key(url);
+    shard &s = m_shards[std::hash<std::string>()(key) % SHARD_COUNT];
+    std::unique_lock<std::mutex> lock(s.mutex);
+
+    file_entry *entry;
+    auto it = s.entries.find(key);
+    if (it != s.entries.end())
+    {
+        entry = it->second;
+        ++entry->refs;
+        //同一URL的第一个请求还在加载，等它完成后直接使用它的结果
+        s.loaded.wait(lock, [entry] { return entry->state != file_entry::LOADING; });
+    }
+    else
+    {
+        evict(s);
+        entry = create(key, m_root + key);
+        entry->refs = 2;// 缓存与本请求各持有一个引用
+        s.entries[key] = entry;
+
+        //启动后的未命中（如文件修改后）不在请求线程上压缩，等待同一缓存项的请求也不被拖住
+        lock.unlock();
+        load(entry, !m_background);
+        if (m_background && m_precompress && entry->text && !entry->error)
+            compress_later(entry);
+        lock.lock();
+
+        entry->state = entry->error ? file_entry::FAILED : file_entry::READY;
+        if (entry->state == file_entry::FAILED)
+        {
+            //不缓存失败的结果，文件随后被创建时下一个请求重新加载；加载期间可能已被invalidate摘下
+            auto cur = s.entries.find(key);
+            if (cur != s.entries.end() && cur->second == entry)
+            {
+                s.entries.erase(cur);
+                --entry->refs;
+            }
+        }
+        s.loaded.notify_all();
+    }
+
+    if (entry->state == file_entry::READY)
+        return entry;
+    error = entry->error;
+    lock.unlock();
+    release(entry);
+    return nullptr;
+}
+
+//分片已满：摘下一个已加载完成的缓存项，正在加载的项还有请求在等待，不能摘下
+void file_cache::evict(shard &s)
+{
+    if (s.entries.size() < SHARD_CAPACITY)
+        return;
+    for (auto it = s.entries.begin(); it != s.entries.end(); ++it)
+    {
+        if (it->second->state != file_entry::LOADING)
+        {
+            file_entry *entry = it->second;
+            s.entries.erase(it);
+            release(entry);
+            return;
+        }
+    }
+}
+
+file_entry *file_cache::find(const char *url)
+{
+    std::string key(url);
+    shard &s = m_shards[std::hash<std::string>()(key) % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.entries.find(key);
+    if (it == s.entries.end() || it->second->state != file_entry::READY)
+        return nullptr;
+    ++it->second->refs;
+    return it->second;
+}
+
+void file_cache::release(file_entry *entry)
+{
+    if (--entry->refs > 0)
+        return;
+    if (entry->fd != -1)
+        close(entry->fd);
+    if (entry->address)
+        munmap(entry->address, entry->st.st_size);
+    delete entry;
+}
+
+//与原来do_request中的检查顺序一致：不存在、其他用户不可读、是目录
+void file_cache::load(file_entry *entry, bool compress_now)
+{
+    if (stat(entry->path.c_str(), &entry->st) < 0)
+    {
+        entry->error = ENOENT;
+        return;
+    }
+    if (!(entry->st.st_mode & S_IROTH))
+    {
+        entry->error = EACCES;
+        return;
+    }
+    if (S_ISDIR(entry->st.st_mode))
+    {
+        entry->error = EISDIR;
+        return;
+    }
+
+    if (entry->st.st_size != 0)
+    {
+        int fd = open(entry->path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            entry->error = ENOENT;
+            return;
+        }
+        if (m_map)
+        {
+            void *address = mmap(0, entry->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (address == MAP_FAILED)
+            {
+                entry->error = ENOENT;
+                return;
+            }
+            entry->address = (char *)address;
+        }
+        else
+            entry->fd = fd;
+    }
+
+    //文本类文件不论是否预压缩都可能被即时压缩，原内容的响应也带Vary
+    entry->text = compressible(entry->path);
+    make_policy(entry);
+    if (entry->text && m_precompress && compress_now)
+        compress(entry);
+    make_header(entry, file_entry::IDENTITY, entry->st.st_size);
+}
+
+//Expires按加载时刻计算，缓存项留在内存中的时间越长它就越早于实际的max-age，对只认Expires的HTTP/1.0缓存只会更保守
+void file_cache::make_policy(file_entry *entry)
+{
+    entry->policy = "Content-Type:";
+    entry->policy += mime_type_of(entry->url.c_str());
+    entry->policy += "\r\n";
+    for (const cache_rule &rule : m_rules)
+    {
+        if (fnmatch(rule.pattern.c_str(), entry->url.c_str(), 0) != 0)
+            continue;
+        if (!rule.cache_control.empty())
+            entry->policy += "Cache-Control:" + rule.cache_control + "\r\n";
+        if (rule.max_age >= 0)
+        {
+            char expires[64];
+            struct tm tm;
+            time_t t = time(nullptr) + rule.max_age;
+            gmtime_r(&t, &tm);
+            strftime(expires, sizeof(expires), "Expires:%a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+            entry->policy += expires;
+        }
+        break;
+    }
+}
+
+//压缩版本只在比原文件小10%以上时保留，否则客户端支持压缩也发送原文件
+void file_cache::compress(file_entry *entry)
+{
+    off_t size = entry->st.st_size;
+    if (size < MIN_COMPRESS_SIZE || size > MAX_COMPRESS_SIZE)
+        return;
+
+    std::string content;
+    const char *data = entry->address;
+    if (!data)
+    {
+        content.resize(size);
+        if (pread(entry->fd, &content[0], size, 0) != size)
+            return;
+        data = content.data();
+    }
+
+    for (int i = file_entry::GZIP; i < file_entry::ENCODING_COUNT; ++i)
+    {
+        file_entry::variant &v = entry->variants[i];
+        bool ok = i == file_entry::GZIP ? gzip_compress(data, size, v.body) : brotli_compress(data, size, v.body);
+        if (!ok || (off_t)v.body.size() > size - size / 10)
+        {
+            std::string().swap(v.body);
+            continue;
+        }
+        v.body.shrink_to_fit();
+        make_header(entry, i, v.body.size());
+    }
+}
+
+void file_cache::compress_later(file_entry *entry)
+{
+    off_t size = entry->st.st_size;
+    if (size < MIN_COMPRESS_SIZE || size > MAX_COMPRESS_SIZE)
+        return;
+    retain(entry);
+    {
+        std::lock_guard<std::mutex> lock(m_compress_mutex);
+        m_compress_queue.push_back(entry);
+    }
+    m_compress_ready.notify_one();
+}
+
+//缓存项加载完成后只读，压缩版本不能在原项上原地写入：重新加载一个带压缩版本的新项，
+//原项仍在缓存中（期间没有被invalidate摘下或淘汰）时替换它，正在发送原内容的请求继续持有原项
+void file_cache::compress_loop()
+{
+    while (true)
+    {
+        file_entry *old;
+        {
+            std::unique_lock<std::mutex> lock(m_compress_mutex);
+            m_compress_ready.wait(lock, [this] { return !m_compress_queue.empty(); });
+            old = m_compress_queue.front();
+            m_compress_queue.pop_front();
+        }
+
+        file_entry *entry = create(old->url, old->path);
+        load(entry, true);
+        entry->state = entry->error ? file_entry::FAILED : file_entry::READY;
+
+        shard &s = m_shards[std::hash<std::string>()(old->url) % SHARD_COUNT];
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.entries.find(old->url);
+            if (entry->state == file_entry::READY && it != s.entries.end() && it->second == old)
+            {
+                it->second = entry;
+                entry = old;// 缓存对原项的引用随后释放
+            }
+        }
+        release(entry);
+        release(old);
+    }
+}
+
+void file_cache::preload(const std::string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *item = readdir(d))
+    {
+        std::string path = dir + "/" + item->d_name;
+        if (item->d_type == DT_DIR && strcmp(item->d_name, ".") != 0 && strcmp(item->d_name, "..") != 0)
+            preload(path);
+        else if (item->d_type == DT_REG && compressible(path))
+        {
+            int error = 0;
+            file_entry *entry = acquire(path.c_str() + m_root.size(), error);
+            if (entry)
+                release(entry);
+        }
+    }
+    closedir(d);
+}
+
+void file_cache::invalidate(const std::string &path)
+{
+    for (int i = 0; i < SHARD_COUNT; ++i)
+    {
+        shard &s = m_shards[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto it = s.entries.begin(); it != s.entries.end();)
+        {
+            const std::string &cached = it->second->path;
+            bool match = path.empty() || cached == path ||
+                         (cached.size() > path.size() && cached.compare(0, path.size(), path) == 0 && cached[path.size()] == '/');
+            if (match)
+            {
+                file_entry *entry = it->second;
+                it = s.entries.erase(it);
+                release(entry);// 正在发送的请求仍持有引用，发送完后才关闭
+            }
+            else
+                ++it;
+        }
+    }
+}
+
+void file_cache::add_watch(const std::string &dir)
+{
+    int wd = inotify_add_watch(m_inotifyfd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0)
+        return;
+    m_watches[wd] = dir;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    while (struct dirent *item = readdir(d))
+    {
+        if (item->d_type == DT_DIR && strcmp(item->d_name, ".") != 0 && strcmp(item->d_name, "..") != 0)
+            add_watch(dir + "/" + item->d_name);
+    }
+    closedir(d);
+}
+
+void file_cache::watch_loop()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        int len = read(m_inotifyfd, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            if (len < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        for (char *p = buf; p < buf + len;)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            //事件队列溢出，无法知道哪些文件变了，全部摘下
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                invalidate("");
+                continue;
+            }
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end())
+                continue;
+            if (event->mask & IN_IGNORED)
+            {
+                m_watches.erase(watch);
+                continue;
+            }
+
+            std::string path = event->len ? watch->second + "/" + event->name : watch->second;
+            if ((event->mask & IN_CREATE) && (event->mask & IN_ISDIR))
+                add_watch(path);
+            invalidate(path);
+        }
+    }
+}
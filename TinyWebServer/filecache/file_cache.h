@@ -0,0 +1,130 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//静态文件缓存项：解析好的路径、stat结果、打开的fd或整个文件的映射，以及预先序列化的状态行和Content-Length；
+//可压缩的文件还在内存中保存gzip（与brotli）压缩后的内容与对应的响应头。
+//缓存项带引用计数，连接在响应发送完之前持有一个引用，文件被修改后缓存项从缓存中摘下，最后一个引用释放时才关闭fd或取消映射
+struct file_entry
+{
+    enum STATE
+    {
+        LOADING = 0,// 第一个请求正在stat/open，其余请求等待
+        READY,// 可以直接使用
+        FAILED// 文件不存在、无权限或是目录，error记录原因
+    };
+    enum ENCODING
+    {
+        IDENTITY = 0,// 原始内容，从fd或映射发送
+        GZIP,
+        BROTLI,
+        ENCODING_COUNT
+    };
+    struct variant //一种编码的响应头与内容，IDENTITY的内容不在这里
+    {
+        std::string header;// "HTTP/1.1 200 OK\r\nContent-Length:N\r\n"，压缩版本还带Content-Encoding，可压缩文件都带Vary，以及ETag与Last-Modified
+        std::string body;// 压缩后的内容，为空表示没有该编码的版本
+        std::string etag;// 强ETag，压缩版本在原内容的ETag后加编码后缀，不同编码的字节不同
+        size_t fields;// header中Content-Length之后的头部的起始位置，206响应复用这一部分
+    };
+
+    std::string url;// 缓存键，网站根目录下的URL路径
+    std::string path;// 完整的文件路径
+    struct stat st;// 文件状态
+    int fd;// sendfile方式使用的fd，不需要时为-1
+    char *address;// mmap方式下整个文件的映射，不需要时为空
+    variant variants[ENCODING_COUNT];
+    std::string last_modified;// Last-Modified的取值，If-Range按日期比较时使用
+    std::string policy;// Content-Type与按规则生成的Cache-Control、Expires头部，各种响应共用
+    bool text;// 文本类文件，可以压缩，响应带Vary
+    STATE state;
+    int error;// 加载失败的原因：ENOENT、EACCES或EISDIR
+    std::atomic<int> refs;// 缓存本身持有一个引用，每个正在使用的请求各持有一个
+};
+
+//按URL分片的静态文件缓存：同一分片内的查找、插入在分片的互斥锁下完成，stat/open/mmap在锁外进行；
+//同一URL并发未命中时只有第一个请求加载，其余请求在分片的条件变量上等待同一个缓存项。
+//后台线程用inotify监视网站根目录及其子目录，文件被修改、删除或移动时摘下对应的缓存项；
+//开启预压缩时，启动后未命中的文件先按原内容缓存，由压缩线程生成压缩版本后整项替换
+class file_cache
+{
+public:
+    static file_cache *get_instance()//获取文件缓存的单例实例
+    {
+        static file_cache instance;
+        return &instance;
+    }
+
+    //读取缓存策略规则文件，file为空时使用内置规则，须在init之前调用
+    bool load_rules(const char *file);
+
+    //root为网站根目录；map为true时缓存整个文件的映射（mmap发送方式），否则缓存打开的fd（sendfile）；
+    //precompress为true时扫描网站根目录，预先加载可压缩的文件并生成压缩版本
+    bool init(const char *root, bool map, bool precompress);
+
+    //按URL取得缓存项并增加引用，失败返回空并通过error给出原因
+    file_entry *acquire(const char *url, int &error);
+    file_entry *find(const char *url);// 只在已缓存且加载完成时取得缓存项，不加载文件
+    std::string path(const char *url) const { return m_root + url; }// URL对应的完整文件路径
+    static void release(file_entry *entry);// 请求用完缓存项后释放引用
+    static void retain(file_entry *entry) { ++entry->refs; }// 已持有引用时再增加一个，交给另一个使用者
+
+    void invalidate(const std::string &path);// 摘下路径为path或位于目录path之下的缓存项，path为空时清空全部
+
+    //由inode、大小和修改时间生成强ETag（带引号），suffix为编码后缀，可为空
+    static void make_etag(const struct stat &st, const char *suffix, char *buf, int size);
+
+private:
+    file_cache();
+    ~file_cache() {}
+
+    static file_entry *create(const std::string &url, const std::string &path);// 新的缓存项，状态为LOADING
+    void load(file_entry *entry, bool compress_now);// 在锁外完成stat/open/mmap与响应头的序列化
+    void compress(file_entry *entry);// 生成可压缩文件的gzip/brotli版本
+    void compress_later(file_entry *entry);// 交给压缩线程，持有一个引用直到处理完
+    void compress_loop();// 压缩线程：重新加载并压缩，缓存中仍是原来的项时替换它
+    void preload(const std::string &dir);// 启动时加载目录下全部可压缩的文件
+    void make_policy(file_entry *entry);// 生成Content-Type与缓存策略头部
+    void add_watch(const std::string &dir);// 监视目录及其子目录
+    void watch_loop();// inotify监视线程
+
+private:
+    static const int SHARD_COUNT = 16;
+    static const size_t SHARD_CAPACITY = 256;// 每个分片最多缓存的文件数，同一文件的不同URL写法各占一项，满了就淘汰一项
+    struct shard
+    {
+        std::mutex mutex;
+        std::condition_variable loaded;// 缓存项加载完成
+        std::unordered_map<std::string, file_entry *> entries;
+    };
+    void evict(shard &s);// 分片已满时摘下一个缓存项，调用时持有分片的锁
+
+    shard m_shards[SHARD_COUNT];
+    std::string m_root;// 网站根目录
+    bool m_map;// 缓存文件映射还是fd
+    bool m_precompress;// 是否生成压缩版本
+    struct cache_rule //缓存策略规则：URL匹配pattern（fnmatch通配）的文件带上Cache-Control，按先后顺序取第一条
+    {
+        std::string pattern;
+        std::string cache_control;// Cache-Control的取值
+        long max_age;// 从cache_control中解析出的max-age，用于生成Expires，没有时为-1
+    };
+    std::vector<cache_rule> m_rules;
+    int m_inotifyfd;
+    std::unordered_map<int, std::string> m_watches;// inotify监视描述符对应的目录，初始化后只由监视线程访问
+    bool m_background;// 预加载已完成，之后的压缩交给压缩线程，不在请求线程上进行
+    std::mutex m_compress_mutex;
+    std::condition_variable m_compress_ready;
+    std::deque<file_entry *> m_compress_queue;// 等待压缩的缓存项
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//扩展名到MIME类型的完美哈希表：哈希表在编译期构造，static_assert保证表中的扩展名互不冲突，
+//查找时只计算一次哈希并比较一个槽。增加扩展名后若编译报冲突，重新选择MIME_HASH_SEED即可
+struct mime_type
+{
+    const char *ext;// 小写扩展名，不含'.'
+    const char *type;// Content-Type的取值
+};
+
+static constexpr mime_type MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"gif", "image/gif"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"png", "image/png"},
+    {"webp", "image/webp"},
+    {"avif", "image/avif"},
+    {"bmp", "image/bmp"},
+    {"mp4", "video/mp4"},
+    {"webm", "video/webm"},
+    {"ogg", "audio/ogg"},
+    {"mp3", "audio/mpeg"},
+    {"wav", "audio/wav"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"pdf", "application/pdf"},
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+    {"wasm", "application/wasm"},
+    {"map", "application/json"},
+    {"csv", "text/csv; charset=utf-8"},
+    {"md", "text/markdown; charset=utf-8"},
+};
+static constexpr const char *MIME_DEFAULT = "application/octet-stream";// 未知扩展名
+
+static constexpr int MIME_TABLE_SIZE = 64;
+static constexpr uint32_t MIME_HASH_SEED = 153417;
+
+//FNV-1a，取高位作为槽号；大写字母先转小写
+constexpr int mime_hash(const char *ext, size_t len)
+{
+    uint32_t h = MIME_HASH_SEED;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = ext[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        h = (h ^ c) * 16777619u;
+    }
+    return (h >> 24) % MIME_TABLE_SIZE;
+}
+
+constexpr size_t mime_strlen(const char *s)
+{
+    size_t n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
+
+struct mime_table
+{
+    int slot[MIME_TABLE_SIZE];// 槽中是MIME_TYPES的下标，空槽为-1
+    bool perfect;// 没有两个扩展名落在同一个槽
+};
+
+constexpr mime_table build_mime_table()
+{
+    mime_table table{};
+    table.perfect = true;
+    for (int i = 0; i < MIME_TABLE_SIZE; ++i)
+        table.slot[i] = -1;
+    for (int i = 0; i < (int)(sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0])); ++i)
+    {
+        int h = mime_hash(MIME_TYPES[i].ext, mime_strlen(MIME_TYPES[i].ext));
+        if (table.slot[h] != -1)
+            table.perfect = false;
+        table.slot[h] = i;
+    }
+    return table;
+}
+
+static constexpr mime_table MIME_TABLE = build_mime_table();
+static_assert(MIME_TABLE.perfect, "MIME extensions collide, choose another MIME_HASH_SEED");
+
+//按文件路径的扩展名查找Content-Type，没有扩展名或未知时返回application/octet-stream
+inline const char *mime_type_of(const char *path)
+{
+    const char *dot = nullptr;
+    for (const char *p = path; *p; ++p)
+    {
+        if (*p == '.')
+            dot = p;
+        else if (*p == '/')
+            dot = nullptr;
+    }
+    if (!dot)
+        return MIME_DEFAULT;
+    const char *ext = dot + 1;
+    size_t len = mime_strlen(ext);
+    int index = MIME_TABLE.slot[mime_hash(ext, len)];
+    if (index < 0)
+        return MIME_DEFAULT;
+    const char *known = MIME_TYPES[index].ext;
+    for (size_t i = 0; i <= len; ++i)
+    {
+        unsigned char c = ext[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != (unsigned char)known[i])
+            return MIME_DEFAULT;
+    }
+    return MIME_TYPES[index].type;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef BODY_STREAM_H
+#define BODY_STREAM_H
+
+#include <string>
+
+//分段生成的响应体：长度事先未知，上一段发送完后才生成下一段，不必先在内存中生成完整的响应体。
+//http_conn把每一段按chunked编码发送，最后一段之后发送0长度块，长连接照常保持
+class body_stream
+{
+public:
+    //把下一段内容追加到out（可以为空），内容全部生成后把done置为true；出错返回false，连接在已发送的部分之后关闭
+    virtual bool next(std::string &out, bool &done) = 0;
+    virtual void close() = 0;// 响应结束或连接关闭时调用，之后不再使用该对象
+
+protected:
+    virtual ~body_stream() {}
+};
+
+#endif
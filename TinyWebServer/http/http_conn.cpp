@@ -1,6 +1,5 @@
 #include "http_conn.h"
 
-#include <mysql/mysql.h>
 #include <fstream>
 
 //定义http响应的一些状态信息
@@ -13,38 +12,79 @@ const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
 const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
+const char *error_413_title = "Payload Too Large";
+const char *error_413_form = "The request body is larger than the server is willing to process.\n";
+const char *error_431_title = "Request Header Fields Too Large";
+const char *error_431_form = "The request line or header fields are too large.\n";
 
-locker m_lock;//保护用户数据的互斥锁
-map<string, string> users;//存储用户名和密码的映射，用于用户认证
-
-void http_conn::initmysql_result(connection_pool *connPool)
+//错误响应的状态行、Content-Type、Content-Length与页面内容在启动时一次性序列化，生成响应时直接引用，只补Date与Connection
+struct error_page
 {
-    //先从连接池中取一个连接
-    MYSQL *mysql = nullptr;
-    connectionRAII mysqlcon(&mysql, connPool);
-
-    //在user表中检索username，passwd数据，浏览器端输入
-    if (mysql_query(mysql, "SELECT username,passwd FROM user"))
-    {
-        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
-    }
+    int status;// 状态码，HTTP/2的:status
+    std::string head;// 状态行与固定的头部
+    const char *form;// 页面内容
+    int form_len;
+};
 
-    //从表中检索完整的结果集
-    MYSQL_RES *result = mysql_store_result(mysql);
-
-    //返回结果集中的列数
-    int num_fields = mysql_num_fields(result);
-
-    //返回所有字段结构的数组
-    MYSQL_FIELD *fields = mysql_fetch_fields(result);
+static error_page make_error_page(int status, const char *title, const char *form)
+{
+    error_page page;
+    page.status = status;
+    page.form = form;
+    page.form_len = strlen(form);
+    page.head = "HTTP/1.1 " + std::to_string(status) + " " + title + "\r\nContent-Type:text/html\r\nContent-Length:" +
+                std::to_string(page.form_len) + "\r\n";
+    return page;
+}
 
-    //从结果集中获取下一行，将对应的用户名和密码，存入map中
-    while (MYSQL_ROW row = mysql_fetch_row(result))
+static const error_page page_400 = make_error_page(400, error_400_title, error_400_form);
+static const error_page page_403 = make_error_page(403, error_403_title, error_403_form);
+static const error_page page_404 = make_error_page(404, error_404_title, error_404_form);
+static const error_page page_413 = make_error_page(413, error_413_title, error_413_form);
+static const error_page page_431 = make_error_page(431, error_431_title, error_431_form);
+static const error_page page_500 = make_error_page(500, error_500_title, error_500_form);
+
+//其余响应中固定不变的部分
+static const char head_304[] = "HTTP/1.1 304 Not Modified\r\nETag:";
+static const char head_chunked[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding:chunked\r\nContent-Encoding:gzip\r\nVary:Accept-Encoding\r\n";
+static const char connection_keep_alive[] = "Connection:keep-alive\r\n\r\n";
+static const char connection_close[] = "Connection:close\r\n\r\n";
+static const char empty_page[] = "<html><body></body></html>";// 空文件的响应体
+static const std::string head_empty = "HTTP/1.1 200 OK\r\nContent-Length:" + std::to_string(sizeof(empty_page) - 1) + "\r\n";
+static const char head_206[] = "HTTP/1.1 206 Partial Content\r\n";// 其后紧跟原内容响应头中Content-Length之后的部分
+static const char head_416[] = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length:0\r\nContent-Range:bytes */";
+static const char switching_protocols[] = "HTTP/1.1 101 Switching Protocols\r\nConnection:Upgrade\r\nUpgrade:h2c\r\n\r\n";
+
+//Date头部按秒缓存：秒数变化后第一个加锁的线程格式化到另一个槽再发布，其余线程直接复制当前槽，
+//不在每个响应中调用gmtime_r/strftime。槽到下一秒才会被覆盖，读者的复制早已完成
+static const int DATE_LINE_SIZE = 64;
+static char date_lines[2][DATE_LINE_SIZE];
+static int date_lens[2];
+static std::atomic<int> date_slot(0);
+static std::atomic<time_t> date_second(-1);
+static locker date_lock;
+
+static const char *date_line(int &len)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != date_second.load(std::memory_order_acquire))
     {
-        string temp1(row[0]);
-        string temp2(row[1]);
-        users[temp1] = temp2;// 存入全局users映射
+        date_lock.lock();
+        if (ts.tv_sec != date_second.load(std::memory_order_relaxed))
+        {
+            int slot = 1 - date_slot.load(std::memory_order_relaxed);
+            struct tm tm;
+            gmtime_r(&ts.tv_sec, &tm);
+            date_lens[slot] = strftime(date_lines[slot], DATE_LINE_SIZE, "Date:%a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+            date_slot.store(slot, std::memory_order_release);
+            date_second.store(ts.tv_sec, std::memory_order_release);
+        }
+        date_lock.unlock();
     }
+    int slot = date_slot.load(std::memory_order_acquire);
+    len = date_lens[slot];
+    return date_lines[slot];
 }
 
 //对文件描述符设置非阻塞
@@ -94,40 +134,63 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
-int http_conn::m_user_count = 0;//统计当前用户连接数
-int http_conn::m_epollfd = -1;//所有 HTTP 连接共享的 epoll 文件描述符
+std::atomic<int> http_conn::m_user_count(0);//统计当前用户连接数
+thread_local int http_conn::t_rearm_ev = -1;
+buffer_pool http_conn::m_buffer_pool(http_conn::IO_BLOCK_SIZE);
+long http_conn::m_max_request = 64 * 1024;
+bool http_conn::m_sendfile = true;
+bool http_conn::m_http2 = true;
 
-//关闭连接，关闭一个连接，客户总量减一
-void http_conn::close_conn(bool real_close)
+//关闭连接，客户总量减一；定时器超时、对端关闭与读写出错都经定时器回调cb_func走到这里
+//与resume持同一把锁：执行线程要么在关闭前交回结果，要么看到递增后的代数
+void http_conn::close_conn()
 {
-    if (real_close && (m_sockfd != -1))
+    m_close_lock.lock();
+    if (m_sockfd != -1)
     {
-        printf("close %d\n", m_sockfd);
+        m_generation++;// 仍在执行的数据库查询的结果将被丢弃
         removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
         m_user_count--;
     }
+    m_close_lock.unlock();
+    release_closed();
+}
+
+//缓冲块、文件缓存项（打开的fd或映射）与HTTP/2会话在关闭时就归还，不等该fd被新连接复用；
+//只在所属事件循环中调用，工作线程仍持有连接时由它的完成通知到达后再调用
+void http_conn::release_closed()
+{
+    if (m_sockfd != -1 || m_in_pool)
+        return;
+    reset_output();
+    release_buffers();
+    release_h2();
 }
 
 //初始化连接,外部调用初始化套接字地址
 void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
-                     int close_log, string user, string passwd, string sqlname)
+                     int close_log, int epollfd)
 {
+    m_close_lock.lock();// fd号被复用时，旧连接的close_conn可能还没有返回
     m_sockfd = sockfd;
+    m_epollfd = epollfd;
+    m_close_lock.unlock();
     m_address = addr;
 
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
-    m_user_count++;
-
     //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
     doc_root = root;
     m_TRIGMode = TRIGMode;
     m_close_log = close_log;
 
-    strcpy(sql_user, user.c_str());
-    strcpy(sql_passwd, passwd.c_str());
-    strcpy(sql_name, sqlname.c_str());
+    if (m_epollfd != -1)
+        addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    else
+        setnonblocking(sockfd);//io_uring后端不使用epoll，只需设置非阻塞
+    m_user_count++;
 
+    release_h2();// 上一个使用该fd的连接异常关闭时留下的会话
+    m_parked = false;
     init();
 }
 
@@ -135,84 +198,196 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
 //check_state默认为分析请求行状态
 void http_conn::init()
 {
-    mysql = nullptr;
-    bytes_to_send = 0;
-    bytes_have_send = 0;
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_linger = false;
     m_method = GET;
     m_url = nullptr;
     m_version = nullptr;
     m_content_length = 0;
-    m_host = nullptr;
+    m_accept_encoding = 0;
+    m_header_count = 0;
+    memset(m_header_index, -1, sizeof(m_header_index));
+    m_chunked = false;
+    m_chunk_state = CHUNK_SIZE;
+    m_chunk_pos = 0;
+    m_chunk_remain = 0;
     m_start_line = 0;
     m_checked_idx = 0;
+    m_line_len = 0;
     m_read_idx = 0;
-    m_write_idx = 0;
-    cgi = 0;
+    m_parsed_bytes = 0;
+    m_read_error = NO_REQUEST;
+    m_read_pending = false;
     m_state = 0;
-    timer_flag = 0;
-    improv = 0;
 
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
-    memset(m_real_file, '\0', FILENAME_LEN);
+    reset_output();
+    release_buffers();//空闲的长连接不占用读写缓冲，下一个请求到达时再借用
 }
 
-//从状态机，用于分析出一行内容,从缓冲区中解析出一行
-//返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
-http_conn::LINE_STATUS http_conn::parse_line()
+void http_conn::reset_output()
+{
+    release_files();
+    bytes_to_send = 0;
+    bytes_have_send = 0;
+    m_write_idx = 0;
+    m_iv_count = 0;
+    m_iv_index = 0;
+    m_file_index = 0;
+    m_batch_linger = false;
+}
+
+void http_conn::attach_buffers()
+{
+    if (m_block)
+        return;
+    m_block = m_buffer_pool.acquire();
+    m_read_buf = m_block;
+    m_read_size = READ_BUFFER_SIZE - 1;// 留1字节，parse_content在请求体末尾写入'\0'时不会写到写缓冲区
+    m_write_buf = m_block + READ_BUFFER_SIZE;
+    m_iv = (struct iovec *)(m_write_buf + WRITE_BUFFER_SIZE);
+    m_files = (file_part *)(m_iv + IOV_PER_RESPONSE * MAX_PIPELINE);
+    m_headers = (http_header *)(m_files + MAX_PIPELINE);
+}
+
+void http_conn::release_buffers()
 {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx)
+    free_segments();
+    if (!m_block)
+        return;
+    m_buffer_pool.release(m_block);
+    m_block = nullptr;
+    m_read_buf = nullptr;
+    m_write_buf = nullptr;
+    m_iv = nullptr;
+    m_files = nullptr;
+    m_headers = nullptr;
+}
+
+//读缓冲区已满：分配更大的新分段继续接收。已解析的行留在旧分段中不动（m_url与头部表仍指向那里），
+//只把尚未解析完的当前行或已收到的部分请求体搬到新分段开头，解析从新分段中继续
+bool http_conn::grow_read_buffer()
+{
+    if (m_parsed_bytes + m_read_idx >= input_limit())
     {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r')
-        {
-            if ((m_checked_idx + 1) == m_read_idx)
-                return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
-            {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-        else if (temp == '\n')
+        m_read_error = (m_check_state == CHECK_STATE_CONTENT) ? BODY_TOO_LARGE : HEADER_TOO_LARGE;
+        return false;
+    }
+
+    long pending = m_read_idx - m_start_line;
+
+    //流水线中前面的请求已处理完，剩下的请求还没有解析出任何行，没有指针指向它，
+    //放得下时搬回缓冲块的读缓冲区开头，释放全部分段
+    if (m_check_state == CHECK_STATE_REQUESTLINE && m_start_line > 0 && pending < READ_BUFFER_SIZE - 1)
+    {
+        memmove(m_block, m_read_buf + m_start_line, pending);
+        free_segments();
+        m_checked_idx -= m_start_line;
+        m_read_idx = pending;
+        m_start_line = 0;
+        m_parsed_bytes = 0;
+        return true;
+    }
+
+    //当前请求从当前分段开始，更早的分段不再被引用
+    if (m_parsed_bytes <= 0 && m_segments)
+    {
+        char *older = *(char **)m_segments;
+        *(char **)m_segments = nullptr;
+        while (older)
         {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
-            {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+            char *prev = *(char **)older;
+            delete[] older;
+            older = prev;
         }
     }
-    return LINE_OPEN;
+
+    long size = m_read_size * 2;
+    if (m_check_state == CHECK_STATE_CONTENT && size < m_content_length)
+        size = m_content_length;// 请求体需要连续存放，按Content-Length一次分配到位
+    long limit = input_limit() - m_parsed_bytes - m_start_line;
+    if (size > limit)
+        size = limit;
+
+    //多分配1字节，parse_content在请求体末尾写入'\0'时不会越界
+    char *segment = new char[sizeof(char *) + size + 1];
+    *(char **)segment = m_segments;
+    m_segments = segment;
+    char *buf = segment + sizeof(char *);
+    memcpy(buf, m_read_buf + m_start_line, pending);
+
+    m_parsed_bytes += m_start_line;
+    m_checked_idx -= m_start_line;
+    m_read_idx = pending;
+    m_start_line = 0;
+    m_read_buf = buf;
+    m_read_size = size;
+    return true;
+}
+
+void http_conn::free_segments()
+{
+    while (m_segments)
+    {
+        char *prev = *(char **)m_segments;
+        delete[] m_segments;
+        m_segments = prev;
+    }
+    m_read_buf = m_block;
+    m_read_size = READ_BUFFER_SIZE - 1;
+}
+
+//有待发送的响应即为发送阶段；否则读缓冲区中有未处理完的数据或头部已解析了一部分说明请求还在读取中；
+//都没有则是长连接在等待下一个请求
+http_conn::TIMEOUT_STATE http_conn::timeout_state() const
+{
+    if (m_parked)
+        return TIMEOUT_PENDING;
+    if (bytes_to_send > 0)
+        return TIMEOUT_WRITE;
+    if (m_check_state == CHECK_STATE_CONTENT)
+        return TIMEOUT_BODY;
+    if (m_read_idx > 0 || m_check_state == CHECK_STATE_HEADER)
+        return TIMEOUT_HEADER;
+    return TIMEOUT_KEEPALIVE;
+}
+
+//从状态机，用于分析出一行内容,从缓冲区中解析出一行
+//返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
+//行结束由向量化扫描找出，不在缓冲区中写入'\0'，行长度记录在m_line_len中；
+//'\r'恰好是已读入的最后一个字节时停在'\r'上，下次读入后从这里重新检查
+http_conn::LINE_STATUS http_conn::parse_line()
+{
+    long end = m_checked_idx + http_scanner::find_eol(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+    m_checked_idx = end;
+    if (end == m_read_idx || (m_read_buf[end] == '\r' && end + 1 == m_read_idx))
+        return LINE_OPEN;
+    if (m_read_buf[end] == '\n' || m_read_buf[end + 1] != '\n')
+        return LINE_BAD;// 单独的'\n'或'\r'
+    m_line_len = end - m_start_line;
+    m_checked_idx = end + 2;
+    return LINE_OK;
 }
 
 //循环读取客户数据，直到无数据可读或对方关闭连接
 //非阻塞ET工作模式下，需要一次性将数据读完
+//缓冲区已满时扩展到新分段；超出单个请求上限时停止读取并返回true，由process_read返回413/431
 bool http_conn::read_once()
 {
-    if (m_read_idx >= READ_BUFFER_SIZE)// 检查缓冲区是否已满
-    {
-        return false;
-    }
+    attach_buffers();
     int bytes_read = 0;
 
     //LT读取数据,读取一次
     if (0 == m_TRIGMode)
     {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-        m_read_idx += bytes_read;
-
+        if (m_read_idx >= m_read_size && !grow_read_buffer())
+            return true;
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
         if (bytes_read <= 0)
         {
+            release_buffers();//读取失败，连接随后会被关闭
             return false;
         }
+        m_read_idx += bytes_read;
 
         return true;
     }
@@ -221,15 +396,19 @@ bool http_conn::read_once()
     {
         while (true)
         {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            if (m_read_idx >= m_read_size && !grow_read_buffer())
+                break;
+            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
             if (bytes_read == -1)
             {
                 if (errno == EAGAIN || errno == EWOULDBLOCK)
                     break;// 没有数据了，退出循环
+                release_buffers();
                 return false;
             }
             else if (bytes_read == 0)
             {
+                release_buffers();
                 return false;// 连接关闭
             }
             m_read_idx += bytes_read;
@@ -239,32 +418,24 @@ bool http_conn::read_once()
 }
 
 //解析http请求行，获得请求方法，目标url及http版本号
-http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
+//方法、URL与版本的边界由向量化扫描给出，方法与版本按长度比较，只在URL之后的空白处写入'\0'
+http_conn::HTTP_CODE http_conn::parse_request_line(char *text, long len)
 {
-    m_url = strpbrk(text, " \t");
-    if (!m_url)
-    {
+    http_token tokens[3];
+    if (!http_scanner::split_request_line(text, len, tokens))
         return BAD_REQUEST;
-    }
-    *m_url++ = '\0';
     char *method = text;//提取请求方法（GET/POST）
-    if (strcasecmp(method, "GET") == 0)
+    if (tokens[0].len == 3 && strncasecmp(method, "GET", 3) == 0)
         m_method = GET;
-    else if (strcasecmp(method, "POST") == 0)
-    {
+    else if (tokens[0].len == 4 && strncasecmp(method, "POST", 4) == 0)
         m_method = POST;
-        cgi = 1;
-    }
     else
         return BAD_REQUEST;
-    m_url += strspn(m_url, " \t");//提取 URL
-    m_version = strpbrk(m_url, " \t");//提取 HTTP 版本
-    if (!m_version)
-        return BAD_REQUEST;
-    *m_version++ = '\0';//规范化 URL
-    m_version += strspn(m_version, " \t");
-    if (strcasecmp(m_version, "HTTP/1.1") != 0)
+    m_version = text + tokens[2].offset;//提取 HTTP 版本
+    if (tokens[2].len != 8 || strncasecmp(m_version, "HTTP/1.1", 8) != 0)
         return BAD_REQUEST;
+    m_url = text + tokens[1].offset;//提取 URL
+    m_url[tokens[1].len] = '\0';
     if (strncasecmp(m_url, "http://", 7) == 0)
     {
         m_url += 7;
@@ -279,58 +450,110 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
-    //当url为/时，显示判断界面
-    if (strlen(m_url) == 1)
-        strcat(m_url, "judge.html");
     m_check_state = CHECK_STATE_HEADER;//设置下一状态为解析头部
     return NO_REQUEST;
 }
 
-//解析http请求的一个头部信息
-http_conn::HTTP_CODE http_conn::parse_headers(char *text)
+//解析Accept-Encoding的取值，如"gzip, deflate, br;q=0.5"，q=0表示明确拒绝该编码，*表示接受任意编码
+static int parse_accept_encoding(const char *value)
 {
-    if (text[0] == '\0')//处理空行（头部结束）
+    int mask = 0;
+    while (*value)
     {
-        if (m_content_length != 0)
+        value += strspn(value, " \t,");
+        size_t item = strcspn(value, ",");// 一个编码及其参数
+        size_t name = strcspn(value, " \t;,");
+        const char *q = (const char *)memmem(value, item, "q=", 2);
+        if (name > 0 && !(q && atof(q + 2) == 0))
         {
-            m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
+            if (name == 4 && strncasecmp(value, "gzip", 4) == 0)
+                mask |= 1 << file_entry::GZIP;
+            else if (name == 2 && strncasecmp(value, "br", 2) == 0)
+                mask |= 1 << file_entry::BROTLI;
+            else if (name == 1 && value[0] == '*')
+                mask |= (1 << file_entry::GZIP) | (1 << file_entry::BROTLI);
         }
-        return GET_REQUEST;
+        value += item;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)//提取 Connection 字段（是否保持连接）
+    return mask;
+}
+
+//解析http请求的一个头部信息：text不以'\0'结尾，长度为len。名称由完美哈希识别，名称与取值的位置记入头部表，
+//不复制也不写缓冲区；头部结束时才从表中取出连接属性需要的几个头部
+http_conn::HTTP_CODE http_conn::parse_headers(char *text, long len)
+{
+    if (len == 0)//处理空行（头部结束）
     {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
-        {
+        char *value;
+        if ((value = header(HEADER_CONNECTION)) && strcasecmp(value, "keep-alive") == 0)
             m_linger = true;
+        if ((value = header(HEADER_CONTENT_LENGTH)))
+            m_content_length = atol(value);
+        if ((value = header(HEADER_ACCEPT_ENCODING)))
+            m_accept_encoding = parse_accept_encoding(value);
+        if ((value = header(HEADER_TRANSFER_ENCODING)))
+        {
+            //同时带Content-Length时以Transfer-Encoding为准，只支持chunked一种编码
+            if (strcasecmp(value, "chunked") != 0)
+                return BAD_REQUEST;
+            m_chunked = true;
+            m_content_length = 0;
+            m_check_state = CHECK_STATE_CONTENT;
+            return NO_REQUEST;
         }
+        if (m_content_length < 0)
+            return BAD_REQUEST;
+        if (m_content_length != 0)
+        {
+            if (m_parsed_bytes + m_checked_idx + m_content_length > m_max_request)
+                return BODY_TOO_LARGE;//请求体超出上限，不必等读完再拒绝
+            m_check_state = CHECK_STATE_CONTENT;
+            return NO_REQUEST;
+        }
+        return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)//提取 Content-length 字段（内容长度）
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0)//提取 Host 字段（主机名）
-    {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    }
-    else
-    {
-        LOG_INFO("oop!unknow header: %s", text);
-    }
+
+    long colon = http_scanner::find_any(text, len, ':', ':');
+    if (colon == len || colon == 0 || colon > 0xffff)
+        return NO_REQUEST;// 没有名称的行忽略
+    if (m_header_count == MAX_HEADERS)
+        return HEADER_TOO_LARGE;
+
+    http_header &h = m_headers[m_header_count];
+    long value = colon + 1 + http_scanner::skip_blank(text + colon + 1, len - colon - 1);
+    long end = len;
+    while (end > value && (text[end - 1] == ' ' || text[end - 1] == '\t'))
+        --end;
+    h.name = text;
+    h.name_len = colon;
+    h.value = text + value;
+    h.value_len = end - value;
+    h.id = header_id_of(text, colon);
+    if (h.id != HEADER_UNKNOWN)
+        m_header_index[h.id] = m_header_count;
+    ++m_header_count;
     return NO_REQUEST;
 }
 
+//取值之后是空白或行末的'\r'，第一次取用时改为'\0'，之后可以按C字符串使用
+char *http_conn::header(int id)
+{
+    int index = m_header_index[id];
+    if (index < 0)
+        return nullptr;
+    http_header &h = m_headers[index];
+    h.value[h.value_len] = '\0';
+    return h.value;
+}
+
 //判断http请求是否被完整读入
 http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
+    if (m_chunked)
+        return parse_chunked(text);
     if (m_read_idx >= (m_content_length + m_checked_idx))
     {
+        m_content_next = text[m_content_length];
         text[m_content_length] = '\0';
         //POST请求中最后为输入的用户名和密码
         m_string = text;
@@ -339,31 +562,101 @@ http_conn::HTTP_CODE http_conn::parse_content(char *text)
     return NO_REQUEST;
 }
 
+//解码后的数据依次前移到请求体起始处，块长度行与CRLF被覆盖；解码位置与已解码长度都相对请求体起始处记录，
+//读缓冲区换到新分段时随未解析的数据一起搬移。全部解码后请求体以'\0'结尾，m_content_length为解码后的长度
+http_conn::HTTP_CODE http_conn::parse_chunked(char *body)
+{
+    long avail = m_read_idx - m_start_line;
+    while (true)
+    {
+        switch (m_chunk_state)
+        {
+        case CHUNK_SIZE:
+        case CHUNK_TRAILER:
+        {
+            long end = m_chunk_pos + http_scanner::find_eol(body + m_chunk_pos, avail - m_chunk_pos);
+            if (end + 1 >= avail)
+                return NO_REQUEST;// 这一行还没有读完
+            if (body[end] != '\r' || body[end + 1] != '\n')
+                return BAD_REQUEST;
+            long line = m_chunk_pos;
+            m_chunk_pos = end + 2;
+            if (m_chunk_state == CHUNK_TRAILER)
+            {
+                if (end == line)
+                {
+                    //空行，请求体结束；尾部头部忽略
+                    body[m_content_length] = '\0';
+                    m_string = body;
+                    return GET_REQUEST;
+                }
+                break;
+            }
+            //块长度是十六进制，其后可以带";扩展"
+            char *digits_end;
+            body[end] = '\0';
+            long size = strtol(body + line, &digits_end, 16);
+            if (digits_end == body + line || size < 0 || (*digits_end != '\0' && *digits_end != ';' && *digits_end != ' '))
+                return BAD_REQUEST;
+            if (m_parsed_bytes + m_start_line + m_content_length + size > m_max_request)
+                return BODY_TOO_LARGE;
+            m_chunk_remain = size;
+            m_chunk_state = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+            break;
+        }
+        case CHUNK_DATA:
+        {
+            long n = avail - m_chunk_pos < m_chunk_remain ? avail - m_chunk_pos : m_chunk_remain;
+            memmove(body + m_content_length, body + m_chunk_pos, n);
+            m_content_length += n;
+            m_chunk_pos += n;
+            m_chunk_remain -= n;
+            if (m_chunk_remain > 0)
+                return NO_REQUEST;
+            m_chunk_state = CHUNK_DATA_END;
+            break;
+        }
+        case CHUNK_DATA_END:
+        {
+            if (avail - m_chunk_pos < 2)
+                return NO_REQUEST;
+            if (body[m_chunk_pos] != '\r' || body[m_chunk_pos + 1] != '\n')
+                return BAD_REQUEST;
+            m_chunk_pos += 2;
+            m_chunk_state = CHUNK_SIZE;
+            break;
+        }
+        }
+    }
+}
+
 http_conn::HTTP_CODE http_conn::process_read()//解析 HTTP 请求
 {
     LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
     char *text = nullptr;
 
-    while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) || ((line_status = parse_line()) == LINE_OK))//使用状态机解析请求的每一行
+    //请求体不按行解析，m_checked_idx停在请求体起始处，请求体分多次读入或被搬到新分段后仍能从这里继续
+    while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) ||
+           (m_check_state != CHECK_STATE_CONTENT && (line_status = parse_line()) == LINE_OK))//使用状态机解析请求的每一行
     {
         text = get_line();
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);
         switch (m_check_state)//根据当前状态调用相应的解析函数
         {
         case CHECK_STATE_REQUESTLINE:
         {
-            ret = parse_request_line(text);
+            LOG_INFO("%.*s", (int)m_line_len, text);//每个请求只记录请求行，不逐个记录头部
+            ret = parse_request_line(text, m_line_len);
             if (ret == BAD_REQUEST)
                 return BAD_REQUEST;
             break;
         }
         case CHECK_STATE_HEADER:
         {
-            ret = parse_headers(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
+            ret = parse_headers(text, m_line_len);
+            if (ret == BAD_REQUEST || ret == BODY_TOO_LARGE || ret == HEADER_TOO_LARGE)
+                return ret;
             else if (ret == GET_REQUEST)
             {
                 return do_request();//如果解析到完整请求，调用 do_request 处理请求
@@ -375,6 +668,11 @@ http_conn::HTTP_CODE http_conn::process_read()//解析 HTTP 请求
             ret = parse_content(text);
             if (ret == GET_REQUEST)
                 return do_request();//如果解析到完整请求，调用 do_request 处理请求
+            if (ret == BAD_REQUEST || ret == BODY_TOO_LARGE)
+            {
+                m_linger = false;// 请求体不完整，无法确定流水线中下一个请求的起点
+                return ret;
+            }
             line_status = LINE_OPEN;
             break;
         }
@@ -382,258 +680,223 @@ http_conn::HTTP_CODE http_conn::process_read()//解析 HTTP 请求
             return INTERNAL_ERROR;
         }
     }
-    return NO_REQUEST;
+    //已读入的数据解析完请求仍不完整，若读取时已超出上限则拒绝，否则继续读取
+    return m_read_error;
 }
 
+//按方法与路径查路由表，处理器给出要发送的文件：登录、注册查询数据库后给出结果页面，固定页面与静态文件不访问数据库
 http_conn::HTTP_CODE http_conn::do_request()
 {
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    //printf("m_url:%s\n", m_url);
-    const char *p = strrchr(m_url, '/');
-
-    //处理CGI（登录和注册）
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
+    route_request req;
+    req.method = m_method == POST ? ROUTE_POST : ROUTE_GET;
+    req.path = m_url;
+    req.path_len = strlen(m_url);
+    req.body = m_method == POST ? m_string : nullptr;
+    req.waiter = this;
+    req.generation = m_generation;
+    req.job = nullptr;
+    route_handler *handler = router::get_instance()->match(req);
+    const char *url = handler ? handler->handle(req) : nullptr;
+    if (url == route_handler::PENDING)
     {
+        //解析状态与之前的响应都原样保留，结果交回后由serve_file继续
+        m_parked = true;
+        m_job = req.job;
+        return PENDING_REQUEST;
+    }
+    return serve_file(url);
+}
 
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
+http_conn::HTTP_CODE http_conn::serve_file(const char *url)
+{
+    if (!url)
+        return NO_RESOURCE;
 
-        std::string url_real = "/";
-        url_real += (m_url + 2);
-        strncpy(m_real_file + len, url_real.c_str(), FILENAME_LEN - len - 1);
+    //条件请求：缓存命中时直接与缓存项比较，未缓存时只stat，匹配则返回304，不打开文件
+    if (m_method == GET && (m_header_index[HEADER_IF_NONE_MATCH] >= 0 || m_header_index[HEADER_IF_MODIFIED_SINCE] >= 0))
+    {
+        file_cache *cache = file_cache::get_instance();
+        file_entry *entry = cache->find(url);
+        struct stat st;
+        bool matched = false;
+        if (entry)
+        {
+            matched = not_modified(entry->st, entry);
+            file_cache::release(entry);
+        }
+        else if (stat(cache->path(url).c_str(), &st) == 0 && S_ISREG(st.st_mode) && (st.st_mode & S_IROTH))
+            matched = not_modified(st, nullptr);
+        if (matched)
+            return NOT_MODIFIED;
+    }
 
-        //将用户名和密码提取出来
-        //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
+    //从文件缓存取得目标文件：命中时不再stat/open，同一文件并发未命中时只加载一次
+    int error = 0;
+    m_file = file_cache::get_instance()->acquire(url, error);
+    if (!m_file)
+    {
+        if (error == EACCES)
+            return FORBIDDEN_REQUEST;
+        if (error == EISDIR)
+            return BAD_REQUEST;
+        return NO_RESOURCE;
+    }
+    return FILE_REQUEST;
+}
 
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
 
-        // 注册处理
-        if (*(p + 1) == '3')
+//If-None-Match优先：与各编码版本的ETag比较（弱比较，忽略W/前缀），*匹配任意版本；
+//没有If-None-Match时才比较If-Modified-Since。满足时把304响应要带的ETag写入m_etag
+bool http_conn::not_modified(const struct stat &st, const file_entry *entry)
+{
+    const char *if_none_match = header(HEADER_IF_NONE_MATCH);
+    if (if_none_match)
+    {
+        char tags[file_entry::ENCODING_COUNT][64];
+        static const char *suffixes[file_entry::ENCODING_COUNT] = {nullptr, "gzip", "br"};
+        for (int i = 0; i < file_entry::ENCODING_COUNT; ++i)
         {
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据
-            if (users.find(name) == users.end())//// 内存中不存在重名用户
+            //缓存项中没有的压缩版本不会被客户端缓存，未缓存时各版本都可能
+            if (entry)
+                snprintf(tags[i], sizeof(tags[i]), "%s", entry->variants[i].etag.c_str());
+            else
+                file_cache::make_etag(st, suffixes[i], tags[i], sizeof(tags[i]));
+        }
+
+        for (const char *p = if_none_match; *p;)
+        {
+            p += strspn(p, " \t,");
+            size_t len = strcspn(p, ",");
+            const char *tag = p;
+            p += len;
+            while (len > 0 && (tag[len - 1] == ' ' || tag[len - 1] == '\t'))
+                --len;
+            if (len > 2 && strncmp(tag, "W/", 2) == 0)
             {
-                m_lock.lock();
-                
-                // 使用预处理语句防止SQL注入
-                const char *sql_insert = "INSERT INTO user(username, passwd) VALUES(?, ?)";
-                MYSQL_STMT *stmt = mysql_stmt_init(mysql);
-                
-                if (stmt == NULL) {
-                    LOG_ERROR("mysql_stmt_init failed: %s", mysql_error(mysql));
-                    m_lock.unlock();
-                    strcpy(m_url, "/registerError.html");
-                } else {
-                    // 准备预处理语句
-                    if (mysql_stmt_prepare(stmt, sql_insert, strlen(sql_insert)) != 0) {
-                        LOG_ERROR("mysql_stmt_prepare failed: %s", mysql_stmt_error(stmt));
-                        mysql_stmt_close(stmt);
-                        m_lock.unlock();
-                        strcpy(m_url, "/registerError.html");
-                    } else {
-                        // 绑定参数
-                        MYSQL_BIND bind[2];
-                        memset(bind, 0, sizeof(bind));
-                        
-                        // 绑定用户名参数
-                        bind[0].buffer_type = MYSQL_TYPE_STRING;
-                        bind[0].buffer = name;
-                        bind[0].buffer_length = strlen(name);
-                        
-                        // 绑定密码参数
-                        bind[1].buffer_type = MYSQL_TYPE_STRING;
-                        bind[1].buffer = password;
-                        bind[1].buffer_length = strlen(password);
-                        
-                        if (mysql_stmt_bind_param(stmt, bind) != 0) {
-                            LOG_ERROR("mysql_stmt_bind_param failed: %s", mysql_stmt_error(stmt));
-                            mysql_stmt_close(stmt);
-                            m_lock.unlock();
-                            strcpy(m_url, "/registerError.html");
-                        } else {
-                            // 执行预处理语句
-                            if (mysql_stmt_execute(stmt) != 0) {
-                                LOG_ERROR("mysql_stmt_execute failed: %s", mysql_stmt_error(stmt));
-                                mysql_stmt_close(stmt);
-                                m_lock.unlock();
-                                strcpy(m_url, "/registerError.html");
-                            } else {
-                                // 插入成功
-                                users.insert(pair<string, string>(name, password));// 更新内存
-                                mysql_stmt_close(stmt);
-                                m_lock.unlock();
-                                strcpy(m_url, "/log.html");
-                            }
-                        }
-                    }
-                }
+                tag += 2;
+                len -= 2;
             }
-            else// 用户已存在
-                strcpy(m_url, "/registerError.html");
-        }
-
-
-        //如果是登录，直接判断
-        //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2')
-        {
-            // 首先从内存中查找（快速验证）
-            if (users.find(name) != users.end() && users[name] == password) {
-                strcpy(m_url, "/welcome.html");
-            } else {
-                // 如果内存中没有找到，使用预处理语句查询数据库
-                m_lock.lock();
-                
-                const char *sql_select = "SELECT passwd FROM user WHERE username = ?";
-                MYSQL_STMT *stmt = mysql_stmt_init(mysql);
-                
-                if (stmt == NULL) {
-                    LOG_ERROR("mysql_stmt_init failed: %s", mysql_error(mysql));
-                    m_lock.unlock();
-                    strcpy(m_url, "/logError.html");
-                } else {
-                    // 准备预处理语句
-                    if (mysql_stmt_prepare(stmt, sql_select, strlen(sql_select)) != 0) {
-                        LOG_ERROR("mysql_stmt_prepare failed: %s", mysql_stmt_error(stmt));
-                        mysql_stmt_close(stmt);
-                        m_lock.unlock();
-                        strcpy(m_url, "/logError.html");
-                    } else {
-                        // 绑定参数
-                        MYSQL_BIND bind[1];
-                        memset(bind, 0, sizeof(bind));
-                        
-                        // 绑定用户名参数
-                        bind[0].buffer_type = MYSQL_TYPE_STRING;
-                        bind[0].buffer = name;
-                        bind[0].buffer_length = strlen(name);
-                        
-                        if (mysql_stmt_bind_param(stmt, bind) != 0) {
-                            LOG_ERROR("mysql_stmt_bind_param failed: %s", mysql_stmt_error(stmt));
-                            mysql_stmt_close(stmt);
-                            m_lock.unlock();
-                            strcpy(m_url, "/logError.html");
-                        } else {
-                            // 执行预处理语句
-                            if (mysql_stmt_execute(stmt) != 0) {
-                                LOG_ERROR("mysql_stmt_execute failed: %s", mysql_stmt_error(stmt));
-                                mysql_stmt_close(stmt);
-                                m_lock.unlock();
-                                strcpy(m_url, "/logError.html");
-                            } else {
-                                // 绑定结果
-                                MYSQL_BIND result_bind;
-                                memset(&result_bind, 0, sizeof(result_bind));
-                                
-                                char db_password[100];
-                                unsigned long password_length;
-                                
-                                result_bind.buffer_type = MYSQL_TYPE_STRING;
-                                result_bind.buffer = db_password;
-                                result_bind.buffer_length = sizeof(db_password);
-                                result_bind.length = &password_length;
-                                
-                                if (mysql_stmt_bind_result(stmt, &result_bind) != 0) {
-                                    LOG_ERROR("mysql_stmt_bind_result failed: %s", mysql_stmt_error(stmt));
-                                    mysql_stmt_close(stmt);
-                                    m_lock.unlock();
-                                    strcpy(m_url, "/logError.html");
-                                } else {
-                                    // 获取结果
-                                    if (mysql_stmt_fetch(stmt) == 0) {
-                                        // 找到用户，验证密码
-                                        db_password[password_length] = '\0';
-                                        if (strcmp(db_password, password) == 0) {
-                                            // 登录成功，更新内存缓存
-                                            users[name] = password;
-                                            mysql_stmt_close(stmt);
-                                            m_lock.unlock();
-                                            strcpy(m_url, "/welcome.html");
-                                        } else {
-                                            mysql_stmt_close(stmt);
-                                            m_lock.unlock();
-                                            strcpy(m_url, "/logError.html");
-                                        }
-                                    } else {
-                                        // 用户不存在
-                                        mysql_stmt_close(stmt);
-                                        m_lock.unlock();
-                                        strcpy(m_url, "/logError.html");
-                                    }
-                                }
-                            }
-                        }
-                    }
+            for (int i = 0; i < file_entry::ENCODING_COUNT; ++i)
+            {
+                if ((len == 1 && tag[0] == '*' && i == file_entry::IDENTITY) ||
+                    (tags[i][0] && len == strlen(tags[i]) && strncmp(tag, tags[i], len) == 0))
+                {
+                    memcpy(m_etag, tags[i], sizeof(m_etag));
+                    return true;
                 }
             }
         }
+        return false;
     }
 
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (!strptime(header(HEADER_IF_MODIFIED_SINCE), "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return false;
+    if (st.st_mtime > timegm(&tm))
+        return false;
+    file_cache::make_etag(st, nullptr, m_etag, sizeof(m_etag));
+    return true;
+}
 
-    // 处理静态页面请求
-    if (*(p + 1) == '0')
-    {
-        const char *m_url_real = "/register.html";
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
-    }
-    else if (*(p + 1) == '1')
+//只支持单个字节范围："bytes=a-b"、"bytes=a-"、"bytes=-n"。多个范围、格式不合法或If-Range不满足时忽略Range，
+//发送整个文件（RFC 7233允许），返回0；范围可满足返回1并给出起点与长度，起点超出文件返回-1
+int http_conn::parse_range(const file_entry *entry, off_t &start, off_t &len)
+{
+    off_t size = entry->st.st_size;
+    const char *range = header(HEADER_RANGE);
+    if (strncasecmp(range, "bytes=", 6) != 0 || strchr(range, ','))
+        return 0;
+
+    //If-Range是ETag时做强比较，是日期时必须与Last-Modified完全相同
+    const char *if_range = header(HEADER_IF_RANGE);
+    if (if_range)
     {
-        const char *m_url_real = "/log.html";
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        const std::string &validator = if_range[0] == '"' ? entry->variants[file_entry::IDENTITY].etag : entry->last_modified;
+        if (validator != if_range)
+            return 0;
     }
-    else if (*(p + 1) == '5')
+
+    const char *p = range + 6;
+    char *end;
+    if (*p == '-')
     {
-        const char *m_url_real = "/picture.html";
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        //最后n个字节
+        if (!isdigit(p[1]))
+            return 0;
+        long long n = strtoll(p + 1, &end, 10);
+        if (*end != '\0')
+            return 0;
+        if (n == 0)
+            return -1;
+        len = n < size ? n : size;
+        start = size - len;
+        return 1;
     }
-    else if (*(p + 1) == '6')
+
+    if (!isdigit(*p))
+        return 0;
+    long long first = strtoll(p, &end, 10);
+    if (*end != '-')
+        return 0;
+    p = end + 1;
+    long long last = size - 1;
+    if (*p)
     {
-        const char *m_url_real = "/video.html";
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        if (!isdigit(*p))
+            return 0;
+        last = strtoll(p, &end, 10);
+        if (*end != '\0' || last < first)
+            return 0;
     }
-    else if (*(p + 1) == '7')
+    if (first >= size)
+        return -1;
+    if (last >= size)
+        last = size - 1;
+    start = first;
+    len = last - first + 1;
+    return 1;
+}
+
+void http_conn::release_files()//释放本批响应中全部文件缓存项的引用，缓存项已被摘下时由最后一个引用关闭fd或取消映射
+{
+    if (m_stream)
     {
-        const char *m_url_real = "/fans.html";
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        m_stream->close();// 分段的响应体可能还在读取文件，先于缓存项释放
+        m_stream = nullptr;
     }
-    else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);//复制登录和注册的文件到真实文件路径
-
-    if (stat(m_real_file, &m_file_stat) < 0)// 检查文件是否存在和可访问
-        return NO_RESOURCE;
-
-    if (!(m_file_stat.st_mode & S_IROTH))
-        return FORBIDDEN_REQUEST;
-
-    if (S_ISDIR(m_file_stat.st_mode))
-        return BAD_REQUEST;
-
-
-    // 将文件映射到内存
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+    for (int i = 0; i < m_file_count; ++i)
+        file_cache::release(m_files[i].entry);
+    m_file_count = 0;
+    if (!m_chunk.empty())
+        std::string().swap(m_chunk);// 空闲连接不保留压缩输出
 }
 
-
-void http_conn::unmap()//取消文件内存映射
+//连续的内存块用一次sendmsg发送，后面紧跟sendfile发送的文件时带MSG_MORE，让响应头与文件开头合并成满的TCP报文；
+//当前是文件则从已发送到的位置继续sendfile，发送位置由consume_output推进
+int http_conn::send_output()
 {
-    if (m_file_address)
+    struct iovec *iv = m_iv + m_iv_index;
+    if (!iv->iov_base)
     {
-        munmap(m_file_address, m_file_stat.st_size);//释放映射的内存区域
-        m_file_address = 0;
+        while (m_files[m_file_index].iov != m_iv_index)// 跳过已发送完或内容在内存中的文件
+            ++m_file_index;
+        file_part &file = m_files[m_file_index];
+        off_t offset = file.offset;
+        int len = sendfile(m_sockfd, file.entry->fd, &offset, iv->iov_len);
+        if (len == 0)
+            errno = EPIPE;// 文件在发送期间被截断，剩余内容已无法发送
+        return len == 0 ? -1 : len;
     }
+
+    int count = 1;
+    while (m_iv_index + count < m_iv_count && m_iv[m_iv_index + count].iov_base)
+        ++count;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iv;
+    msg.msg_iovlen = count;
+    return sendmsg(m_sockfd, &msg, m_iv_index + count < m_iv_count ? MSG_MORE : 0);
 }
 
 
@@ -641,189 +904,789 @@ bool http_conn::write()//向客户端发送 HTTP 响应
 {
     int temp = 0;
 
-    if (bytes_to_send == 0)// 如果没有数据要发送，重新注册读事件并重置连接
+    if (bytes_to_send == 0)// 如果没有数据要发送，重置连接并重新注册读事件
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
         init();
+        rearm(EPOLLIN);
         return true;
     }
 
     while (1)
     {
-        temp = writev(m_sockfd, m_iv, m_iv_count);// 使用writev集中写方式发送数据
+        temp = send_output();// 内存块集中写，文件内容sendfile
 
         if (temp < 0)
         {
             // 如果发送缓冲区已满，等待下次可写事件
             if (errno == EAGAIN)
             {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                rearm(EPOLLOUT);
                 return true;
             }
-            // 其他错误，取消文件映射并返回失败
-            unmap();
+            // 其他错误，释放文件缓存项并返回失败
+            release_files();
             return false;
         }
 
-        // 更新已发送和待发送字节数
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-
-        // 调整iovec结构
-        if (bytes_have_send >= m_iv[0].iov_len)
-        {
-            // 第一个缓冲区已发送完，调整第二个缓冲区
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        else
-        {
-            // 第一个缓冲区还未发送完
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
-
         // 检查是否所有数据都已发送完毕
-        if (bytes_to_send <= 0)
+        //先重置连接、归还缓冲块再重新注册读事件，避免下一个请求的处理线程与本线程同时访问连接
+        //读缓冲区中还有未解析的流水线请求时注册写事件，由事件循环在随后的可写事件中把连接交给线程池
+        if (consume_output(temp) <= 0)
         {
-            unmap();// 取消文件映射
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);// 重新注册读事件
-
-            if (m_linger)// 根据是否保持连接决定是否重置连接状态
-            {
-                init();
-                return true;
-            }
-            else
-            {
+            if (!finish_output())
                 return false;
-            }
+            rearm(m_read_pending ? EPOLLOUT : EPOLLIN);
+            return true;
         }
     }
 }
-bool http_conn::add_response(const char *format, ...)// 使用可变参数格式化字符串到写缓冲区
+
+//记录已发送的字节，调整iovec使其指向尚未发送的部分
+int http_conn::consume_output(int bytes)
+{
+    // 更新已发送和待发送字节数
+    bytes_have_send += bytes;
+    bytes_to_send -= bytes;
+
+    // 跳过已发送完的内存块，调整发送了一部分的那一块，sendfile发送的文件推进发送位置
+    while (bytes > 0 && m_iv_index < m_iv_count)
+    {
+        struct iovec &iv = m_iv[m_iv_index];
+        size_t len = (size_t)bytes < iv.iov_len ? bytes : iv.iov_len;
+        if (iv.iov_base)
+            iv.iov_base = (char *)iv.iov_base + len;
+        else
+            m_files[m_file_index].offset += len;
+        iv.iov_len -= len;
+        bytes -= len;
+        if (iv.iov_len == 0)
+            ++m_iv_index;
+    }
+
+    //分段生成的响应体：当前一段发送完后再生成下一段，之前的iovec都已发送完，从头登记；生成失败时在此结束并关闭连接
+    if (bytes_to_send == 0 && m_stream)
+    {
+        m_iv_index = 0;
+        m_iv_count = 0;
+        if (!next_chunk())
+            m_batch_linger = false;
+    }
+    return bytes_to_send;
+}
+
+bool http_conn::finish_output()
 {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
-    va_list arg_list;
-    va_start(arg_list, format);
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
+    release_files();// 释放文件缓存项
+
+    if (!m_batch_linger)// 本批最后一个响应不保持连接
     {
-        va_end(arg_list);
+        release_buffers();//连接即将关闭
+        release_h2();
         return false;
     }
-    m_write_idx += len;
-    va_end(arg_list);
+    //HTTP/2连接保留会话：还有窗口允许发送的帧，或读缓冲区中已有完整的帧时，不等读事件直接交给线程池
+    if (m_h2)
+    {
+        reset_output();
+        m_read_pending = m_h2->want_write() || m_h2->input_ready(m_read_buf + m_start_line, m_read_idx - m_start_line);
+        if (!m_read_pending && m_read_idx == 0)
+            release_buffers();
+        return true;
+    }
+    //流水线中下一个请求已有数据读入：保留读缓冲区和解析进度，只清空输出状态
+    if (m_read_idx > m_start_line || m_check_state != CHECK_STATE_REQUESTLINE)
+        reset_output();
+    else
+        init();
+    return true;
+}
 
-    LOG_INFO("request:%s", m_write_buf);
+struct msghdr *http_conn::pending_output()
+{
+    memset(&m_msg, 0, sizeof(m_msg));
+    m_msg.msg_iov = m_iv + m_iv_index;
+    m_msg.msg_iovlen = m_iv_count - m_iv_index;
+    return &m_msg;
+}
 
+bool http_conn::append_input(const char *data, int len)
+{
+    attach_buffers();
+    while (len > 0)
+    {
+        if (m_read_idx >= m_read_size && !grow_read_buffer())
+            break;// 超出单个请求上限，丢弃剩余数据，由process_read返回413/431
+        int bytes = len < m_read_size - m_read_idx ? len : m_read_size - m_read_idx;
+        memcpy(m_read_buf + m_read_idx, data, bytes);
+        m_read_idx += bytes;
+        data += bytes;
+        len -= bytes;
+    }
     return true;
 }
-bool http_conn::add_status_line(int status, const char *title)// 添加状态行
+
+void http_conn::rearm(int ev)
+{
+    if (t_rearm_ev >= 0)
+        t_rearm_ev = ev;
+    else if (m_epollfd == -1)// io_uring后端只能由环所在线程提交，resume在持有m_close_lock时带上当前代数投递
+        m_cq->post(m_sockfd, ev, TIMEOUT_PENDING, m_generation);
+    else
+        modfd(m_epollfd, m_sockfd, ev, m_TRIGMode);
+}
+//可变部分写入写缓冲区：与上一段iovec在写缓冲区中相邻时直接延长，否则登记新的一段
+bool http_conn::add_text(const char *text, int len)
+{
+    if (m_write_idx + len > WRITE_BUFFER_SIZE)
+        return false;
+    char *dst = m_write_buf + m_write_idx;
+    memcpy(dst, text, len);
+    m_write_idx += len;
+    struct iovec *last = m_iv_count ? &m_iv[m_iv_count - 1] : nullptr;
+    if (last && last->iov_base && (char *)last->iov_base + last->iov_len == dst)
+    {
+        last->iov_len += len;
+        bytes_to_send += len;
+    }
+    else
+        add_iovec(dst, len);
+    return true;
+}
+bool http_conn::add_number(long long value)
+{
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long n = value < 0 ? -(unsigned long long)value : value;
+    do
+    {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    if (value < 0)
+        *--p = '-';
+    return add_text(p, digits + sizeof(digits) - p);
+}
+bool http_conn::add_tail()
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    int len;
+    const char *date = date_line(len);
+    if (!add_text(date, len))
+        return false;
+    if (m_linger)
+        return add_text(connection_keep_alive, sizeof(connection_keep_alive) - 1);
+    return add_text(connection_close, sizeof(connection_close) - 1);
 }
-bool http_conn::add_headers(int content_len)// 添加头部字段
+bool http_conn::add_error(const error_page &page)
 {
-    return add_content_length(content_len) && add_linger() &&
-           add_blank_line();
+    add_iovec(page.head.data(), page.head.size());
+    if (!add_tail())
+        return false;
+    add_iovec(page.form, page.form_len);
+    m_batch_linger = m_linger;
+    return true;
 }
-bool http_conn::add_content_length(int content_len)// 添加Content-Length字段
+//客户端接受gzip、内容大小合适且本秒的CPU预算还有剩余时，取一个压缩器把内容作为分段的响应体压缩发送；
+//返回空时调用方按原内容发送
+body_stream *http_conn::deflate_body(const char *data, int fd, size_t len)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    if (!(m_accept_encoding & (1 << file_entry::GZIP)) || len < MIN_DEFLATE_SIZE || len > MAX_DEFLATE_SIZE ||
+        !gzip_stream::admit())
+        return nullptr;
+    return gzip_stream::acquire(data, fd, len);
 }
-bool http_conn::add_content_type()// 添加Content-Type字段
+
+//块长度行写在m_chunk开头预留的位置中，紧贴数据，数据不再复制；生成出空的一段时继续生成，直到有数据或内容结束
+bool http_conn::next_chunk()
 {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    static const int CHUNK_HEAD = 10;// 块长度行预留的长度，十六进制长度加CRLF
+    bool done = false;
+    m_chunk.assign(CHUNK_HEAD, ' ');
+    while (m_chunk.size() == (size_t)CHUNK_HEAD && !done)
+    {
+        if (!m_stream->next(m_chunk, done))
+            return false;
+    }
+
+    int start = CHUNK_HEAD;
+    size_t size = m_chunk.size() - CHUNK_HEAD;
+    if (size > 0)
+    {
+        char *p = &m_chunk[CHUNK_HEAD];
+        *--p = '\n';
+        *--p = '\r';
+        do
+        {
+            *--p = "0123456789abcdef"[size & 0xf];
+            size >>= 4;
+        } while (size);
+        start = p - m_chunk.data();
+        m_chunk.append("\r\n", 2);
+    }
+    if (done)
+    {
+        m_chunk.append("0\r\n\r\n", 5);// 结尾的0长度块
+        m_stream->close();
+        m_stream = nullptr;
+    }
+    add_iovec(m_chunk.data() + start, m_chunk.size() - start);
+    return true;
 }
-bool http_conn::add_linger()// 添加Connection字段
+//本批次还能再追加一个响应：响应数未达上限，iovec放得下一个响应的全部分段，写缓冲区剩余空间放得下一个响应的可变部分
+bool http_conn::batch_has_room() const
 {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    //分段生成的响应体发送完最后一段才结束，它之后的请求留到下一批
+    return m_file_count < MAX_PIPELINE && m_iv_count + IOV_PER_RESPONSE <= IOV_PER_RESPONSE * MAX_PIPELINE && WRITE_BUFFER_SIZE - m_write_idx >= MAX_HEADER_SIZE && !m_stream;
 }
-bool http_conn::add_blank_line() // 添加空行
+
+void http_conn::add_iovec(const char *base, int len)
 {
-    return add_response("%s", "\r\n");
+    m_iv[m_iv_count].iov_base = (void *)base;
+    m_iv[m_iv_count].iov_len = len;
+    ++m_iv_count;
+    bytes_to_send += len;
 }
-bool http_conn::add_content(const char *content)// 添加内容
+
+//客户端接受时优先发送brotli，其次gzip
+int http_conn::pick_encoding(const file_entry *entry) const
+{
+    for (int i = file_entry::ENCODING_COUNT - 1; i > file_entry::IDENTITY; --i)
+    {
+        if ((m_accept_encoding & (1 << i)) && !entry->variants[i].body.empty())
+            return i;
+    }
+    return file_entry::IDENTITY;
+}
+
+//HTTP/2中客户端在窗口之内可以连续发送DATA，处理前读缓冲区可能同时有一个请求的头部与一个窗口的请求体
+long http_conn::input_limit() const
 {
-    return add_response("%s", content);
+    return m_h2 ? m_max_request + h2_session::WINDOW_SIZE : m_max_request;
 }
 
-//根据处理结果生成 HTTP 响应
+//当前请求的响应已生成：解析位置移到请求末尾并重置解析状态，缓冲区中其后的字节属于流水线中的下一个请求，原地继续解析
+void http_conn::next_request()
+{
+    long end = m_checked_idx;
+    if (m_check_state == CHECK_STATE_CONTENT && m_chunked)
+        end = m_start_line + m_chunk_pos;// 解码后的请求体写在原处，之后的'\0'也在已解码的范围内
+    else if (m_check_state == CHECK_STATE_CONTENT)
+    {
+        end = m_start_line + m_content_length;
+        m_read_buf[end] = m_content_next;
+    }
+    m_parsed_bytes = -end;// 之前请求的字节不计入下一个请求的上限
+    m_start_line = end;
+    m_checked_idx = end;
+    m_check_state = CHECK_STATE_REQUESTLINE;
+    m_linger = false;
+    m_method = GET;
+    m_url = nullptr;
+    m_version = nullptr;
+    m_content_length = 0;
+    m_accept_encoding = 0;
+    m_header_count = 0;
+    memset(m_header_index, -1, sizeof(m_header_index));
+    m_chunked = false;
+    m_chunk_state = CHUNK_SIZE;
+    m_chunk_pos = 0;
+    m_chunk_remain = 0;
+}
+
+//根据处理结果生成 HTTP 响应，追加到本批次的iovec之后：预先序列化的部分直接引用，
+//Content-Length、Content-Range、ETag、Date与Connection等可变部分写入写缓冲区
 bool http_conn::process_write(HTTP_CODE ret)
 {
     switch (ret)
     {
     case INTERNAL_ERROR:
-    {
-        add_status_line(500, error_500_title);
-        add_headers(strlen(error_500_form));
-        if (!add_content(error_500_form))
-            return false;
-        break;
-    }
+        return add_error(page_500);
     case BAD_REQUEST:
-    {
-        add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
-            return false;
-        break;
-    }
+        return add_error(page_400);
+    case NO_RESOURCE:
+        return add_error(page_404);
+    case HEADER_TOO_LARGE:
+        m_linger = false;// 剩余的请求数据不再读取，响应后关闭连接
+        return add_error(page_431);
+    case BODY_TOO_LARGE:
+        m_linger = false;
+        return add_error(page_413);
     case FORBIDDEN_REQUEST:
+        return add_error(page_403);
+    case NOT_MODIFIED:
     {
-        add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
+        //304没有响应体，只带ETag
+        add_iovec(head_304, sizeof(head_304) - 1);
+        if (!add_text(m_etag, strlen(m_etag)) || !add_text("\r\n", 2) || !add_tail())
             return false;
         break;
     }
     case FILE_REQUEST:
     {
-        add_status_line(200, ok_200_title);
-        if (m_file_stat.st_size != 0)
-        {
-            add_headers(m_file_stat.st_size);
-            //设置 iovec 结构用于高效发送
-            m_iv[0].iov_base = m_write_buf;// HTTP头部缓冲区
-            m_iv[0].iov_len = m_write_idx;// HTTP头部长度
-            m_iv[1].iov_base = m_file_address;// 文件内容地址
-            m_iv[1].iov_len = m_file_stat.st_size;// 文件内容长度
-            m_iv_count = 2;// 两个缓冲区
-            bytes_to_send = m_write_idx + m_file_stat.st_size;//计算需要发送的字节数
-            return true;
+        //先登记文件，生成响应失败时也能在关闭前释放缓存项
+        file_part &file = m_files[m_file_count++];
+        file.entry = m_file;
+        file.offset = 0;
+        file.iov = -1;
+        m_file = nullptr;
+        off_t size = file.entry->st.st_size;
+        off_t range_start = 0, range_len = 0;
+        int range = (m_header_index[HEADER_RANGE] >= 0 && size != 0) ? parse_range(file.entry, range_start, range_len) : 0;
+        if (range < 0)
+        {
+            //范围起点超出文件，告知完整长度
+            add_iovec(head_416, sizeof(head_416) - 1);
+            if (!add_number(size) || !add_text("\r\n", 2) || !add_tail())
+                return false;
+            break;
+        }
+        if (range > 0)
+        {
+            //范围请求总是按原内容发送：状态行之后直接引用缓存项中原内容的ETag、Last-Modified与缓存策略，
+            //按范围生成的Content-Length与Content-Range和Date、Connection一起写在可变部分，一个响应仍只占四段iovec。
+            //从偏移处开始零拷贝：sendfile从记录的偏移续发，mmap方式直接指向映射中的位置
+            const file_entry::variant &v = file.entry->variants[file_entry::IDENTITY];
+            add_iovec(head_206, sizeof(head_206) - 1);
+            add_iovec(v.header.data() + v.fields, v.header.size() - v.fields);
+            if (!add_text("Content-Length:", 15) || !add_number(range_len) || !add_text("\r\nContent-Range:bytes ", 22) ||
+                !add_number(range_start) || !add_text("-", 1) || !add_number(range_start + range_len - 1) || !add_text("/", 1) ||
+                !add_number(size) || !add_text("\r\n", 2) || !add_tail())
+                return false;
+            file.iov = m_iv_count;
+            file.offset = range_start;
+            add_iovec(file.entry->address ? file.entry->address + range_start : nullptr, range_len);
+            break;
+        }
+        if (size != 0)
+        {
+            //压缩版本在内存中，不论哪种发送方式都与响应头一起sendmsg
+            int encoding = pick_encoding(file.entry);
+            const file_entry::variant &v = file.entry->variants[encoding];
+
+            //没有预压缩版本的文本文件即时压缩，长度事先未知，边压缩边按chunked编码发送
+            if (encoding == file_entry::IDENTITY && file.entry->text && (m_stream = deflate_body(file.entry->address, file.entry->fd, size)))
+            {
+                add_iovec(head_chunked, sizeof(head_chunked) - 1);
+                add_iovec(file.entry->policy.data(), file.entry->policy.size());
+                if (!add_tail() || !next_chunk())
+                    return false;
+                break;
+            }
+
+            //状态行、Content-Length、Content-Encoding、ETag与缓存策略已在缓存项中序列化好，直接引用
+            add_iovec(v.header.data(), v.header.size());
+            if (!add_tail())
+                return false;
+            file.iov = m_iv_count;
+            if (encoding != file_entry::IDENTITY)
+                add_iovec(v.body.data(), v.body.size());
+            else
+                add_iovec(file.entry->address, size);// 文件内容，sendfile方式为空
+            break;
         }
         else
         {
-            const char *ok_string = "<html><body></body></html>";
-            add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
+            add_iovec(head_empty.data(), head_empty.size());
+            if (!add_tail())
                 return false;
+            add_iovec(empty_page, sizeof(empty_page) - 1);
         }
+        break;
     }
     default:
         return false;
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    m_batch_linger = m_linger;
     return true;
 }
 void http_conn::process()//处理 HTTP 请求的入口函数
 {
-    HTTP_CODE read_ret = process_read();//解析 HTTP 请求
-    if (read_ret == NO_REQUEST)//如果请求不完整，重新注册读事件
+    m_read_pending = false;
+    if (m_h2 || (!m_parked && m_http2 && h2_preface()))
     {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        process_h2();
         return;
     }
+    HTTP_CODE read_ret;
+    if (m_parked)
+    {
+        //挂起的请求得到结果：从它继续，之后与未挂起时一样处理流水线中剩下的请求
+        m_parked = false;
+        read_ret = serve_file(m_route_target);
+    }
+    else
+    {
+        read_ret = process_read();//解析 HTTP 请求
+        if (read_ret == NO_REQUEST)//如果请求不完整，重新注册读事件
+        {
+            rearm(EPOLLIN);
+            return;
+        }
+        if (read_ret == PENDING_REQUEST)//不注册事件，结果交回时由resume注册
+        {
+            start_job();
+            return;
+        }
+        //h2c升级：101之后连接改用HTTP/2，本请求的响应作为流1发送
+        if (m_http2 && h2_upgrade_requested() && upgrade_h2(read_ret))
+            return;
+    }
+    bool first = m_iv_count == 0;
     bool write_ret = process_write(read_ret);//生成 HTTP 响应
-    if (!write_ret)//如果写入失败，关闭连接
+    if (!write_ret && first)//如果生成响应失败，关闭连接的读写，由所属事件循环在随后的挂断事件中关闭连接并摘下定时器
+    {
+        shutdown(m_sockfd, SHUT_RDWR);
+        rearm(EPOLLIN);
+        return;
+    }
+    //流水线：读缓冲区中已有后续请求时继续原地解析，响应追加到同一批次，由一次writev/sendmsg发送
+    if (write_ret)
+        next_request();
+    else
+        m_batch_linger = false;// 挂起前已有响应在本批中：发送完它们后关闭连接
+    while (m_batch_linger)
+    {
+        if (!batch_has_room())
+        {
+            m_read_pending = m_read_idx > m_start_line;// 剩下的请求等本批发送完再处理
+            break;
+        }
+        read_ret = process_read();
+        if (read_ret == NO_REQUEST)
+            break;
+        if (read_ret == PENDING_REQUEST)// 本批已生成的响应与挂起的请求的响应一起发送
+        {
+            start_job();
+            return;
+        }
+        if (!process_write(read_ret))
+        {
+            m_batch_linger = false;// 无法生成响应，发送完已生成的响应后关闭连接
+            break;
+        }
+        next_request();
+    }
+    rearm(EPOLLOUT);//注册写事件准备发送响应
+}
+
+void http_conn::start_job()
+{
+    route_job *job = m_job;
+    m_job = nullptr;
+    job->start();
+}
+
+//结果只在连接没有关闭过时交回；经写事件回到事件循环，由它像流水线中剩下的请求一样交给线程池，
+//不在执行线程上处理请求
+void http_conn::resume(unsigned generation, const char *target)
+{
+    m_close_lock.lock();
+    if (generation == m_generation)
+    {
+        m_route_target = target;
+        m_read_pending = true;
+        rearm(EPOLLOUT);
+    }
+    m_close_lock.unlock();
+}
+
+//连接前言的第一行"PRI * HTTP/2.0\r\n"只能出现在连接开头，读入这一行后即可判断，其余部分由会话校验
+bool http_conn::h2_preface() const
+{
+    return m_check_state == CHECK_STATE_REQUESTLINE && m_start_line == 0 && m_parsed_bytes == 0 && m_read_idx >= 16 &&
+           memcmp(m_read_buf, h2_session::PREFACE, 16) == 0;
+}
+
+//逗号分隔的取值中是否有token（不区分大小写）
+static bool has_token(const char *list, const char *token)
+{
+    size_t len = strlen(token);
+    while (*list)
+    {
+        list += strspn(list, " \t,");
+        size_t item = strcspn(list, " \t,");
+        if (item == len && strncasecmp(list, token, len) == 0)
+            return true;
+        list += item;
+    }
+    return false;
+}
+
+//只升级没有请求体、已正常处理的GET请求；解析出错的请求照常按HTTP/1.1响应
+bool http_conn::h2_upgrade_requested()
+{
+    if (m_method != GET || m_check_state != CHECK_STATE_HEADER || m_header_index[HEADER_HTTP2_SETTINGS] < 0)
+        return false;
+    const char *upgrade = header(HEADER_UPGRADE);
+    const char *connection = header(HEADER_CONNECTION);
+    return upgrade && connection && has_token(upgrade, "h2c") && has_token(connection, "upgrade");
+}
+
+//101之后紧接服务器的SETTINGS与流1的响应，三者在同一批中发送；客户端随后发来连接前言，
+//读缓冲区中升级请求之后的数据按帧解析
+bool http_conn::upgrade_h2(HTTP_CODE ret)
+{
+    start_h2();
+    h2_stream *s = m_h2->upgrade(header(HEADER_HTTP2_SETTINGS));
+    if (!s)
+    {
+        release_h2();
+        return false;
+    }
+    add_iovec(switching_protocols, sizeof(switching_protocols) - 1);
+    respond_h2(ret, s);
+    next_request();
+    fill_h2_batch();
+    rearm(EPOLLOUT);
+    return true;
+}
+
+//读缓冲区中完整的帧交给会话，剩下不完整的一帧留在原处；读缓冲区被全部消耗时回到缓冲块开头。
+//连接只在有待发送的帧时注册写事件，否则等待客户端的下一帧（新的请求或WINDOW_UPDATE）
+void http_conn::process_h2()
+{
+    attach_buffers();
+    if (!m_h2)
+        start_h2();
+    long used = m_h2->receive(m_read_buf + m_start_line, m_read_idx - m_start_line);
+    m_start_line += used;
+    if (m_start_line == m_read_idx)
+    {
+        free_segments();
+        m_read_idx = 0;
+        m_start_line = 0;
+    }
+    m_checked_idx = m_start_line;
+    m_parsed_bytes = -m_start_line;
+    if (m_read_error != NO_REQUEST)
+    {
+        m_h2->fail(h2_session::ENHANCE_YOUR_CALM);// 未处理的数据超出上限
+        m_read_error = NO_REQUEST;
+    }
+
+    //挂起的流先得到响应，其余就绪的流在它之后处理
+    if (m_parked)
     {
-        close_conn();
+        m_parked = false;
+        respond_h2(serve_file(m_route_target), m_parked_stream);
+        m_parked_stream = nullptr;
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);//注册写事件准备发送响应
+    while (h2_stream *s = m_h2->next_request())
+    {
+        if (!serve_h2(s))
+        {
+            m_parked_stream = s;
+            start_job();
+            return;
+        }
+    }
+
+    fill_h2_batch();
+    if (bytes_to_send == 0)
+    {
+        if (!m_batch_linger)
+            shutdown(m_sockfd, SHUT_RDWR);
+        else if (m_read_idx == 0)
+            release_buffers();
+        rearm(EPOLLIN);
+        return;
+    }
+    rearm(EPOLLOUT);
+}
+
+//伪头部给出方法与路径，其余头部进入头部表，请求体作为m_string，之后与HTTP/1.1一样由do_request处理
+bool http_conn::serve_h2(h2_stream *s)
+{
+    m_header_count = 0;
+    memset(m_header_index, -1, sizeof(m_header_index));
+    m_accept_encoding = 0;
+    m_method = GET;
+    std::string *method = nullptr, *path = nullptr;
+    bool too_many = false;
+    for (hpack_field &f : s->fields)
+    {
+        if (!f.name.empty() && f.name[0] == ':')
+        {
+            if (f.name == ":method")
+                method = &f.value;
+            else if (f.name == ":path")
+                path = &f.value;
+            continue;
+        }
+        if (m_header_count == MAX_HEADERS)
+        {
+            too_many = true;
+            break;
+        }
+        http_header &h = m_headers[m_header_count];
+        h.name = &f.name[0];
+        h.name_len = f.name.size();
+        h.value = &f.value[0];
+        h.value_len = f.value.size();
+        h.id = header_id_of(h.name, h.name_len);
+        if (h.id != HEADER_UNKNOWN)
+            m_header_index[h.id] = m_header_count;
+        ++m_header_count;
+    }
+
+    HTTP_CODE ret = NO_REQUEST;
+    if (!method || !path || path->empty() || (*path)[0] != '/')
+        ret = BAD_REQUEST;
+    else if (too_many || s->list_size > (size_t)m_max_request)
+        ret = HEADER_TOO_LARGE;
+    else if (s->too_large)
+        ret = BODY_TOO_LARGE;
+    else if (*method == "POST")
+        m_method = POST;
+    else if (*method != "GET")
+        ret = BAD_REQUEST;
+
+    if (ret == NO_REQUEST)
+    {
+        LOG_INFO("%s %s HTTP/2", method->c_str(), path->c_str());
+        const char *value = header(HEADER_ACCEPT_ENCODING);
+        if (value)
+            m_accept_encoding = parse_accept_encoding(value);
+        m_url = &(*path)[0];
+        m_string = &s->body[0];
+        ret = do_request();
+        m_url = nullptr;
+        m_string = nullptr;
+        if (ret == PENDING_REQUEST)
+            return false;
+    }
+    respond_h2(ret, s);
+    return true;
+}
+
+//状态码编码为:status，缓存项与错误页面中预先序列化的HTTP/1.1头部逐行转为HPACK字段；响应体与HTTP/1.1相同，
+//引用缓存项中的压缩版本、映射的文件或由sendfile从fd发送。没有即时压缩，文件不存在时回复404而不是关闭连接
+void http_conn::respond_h2(HTTP_CODE ret, h2_stream *s)
+{
+    std::string head;
+    int date_len;
+    const char *date = date_line(date_len);
+    const error_page *page = nullptr;
+    switch (ret)
+    {
+    case INTERNAL_ERROR:
+        page = &page_500;
+        break;
+    case BAD_REQUEST:
+        page = &page_400;
+        break;
+    case NO_RESOURCE:
+        page = &page_404;
+        break;
+    case HEADER_TOO_LARGE:
+        page = &page_431;
+        break;
+    case BODY_TOO_LARGE:
+        page = &page_413;
+        break;
+    case FORBIDDEN_REQUEST:
+        page = &page_403;
+        break;
+    case NOT_MODIFIED:
+        hpack_encoder::add_status(head, 304);
+        hpack_encoder::add_field(head, "etag", 4, m_etag, strlen(m_etag));
+        hpack_encoder::add_http1(head, date, date_len);
+        m_h2->respond(s, head, nullptr, nullptr, 0, 0);
+        return;
+    case FILE_REQUEST:
+    {
+        file_entry *entry = m_file;
+        m_file = nullptr;
+        off_t size = entry->st.st_size;
+        off_t range_start = 0, range_len = 0;
+        int range = (m_header_index[HEADER_RANGE] >= 0 && size != 0) ? parse_range(entry, range_start, range_len) : 0;
+        char value[64];
+        if (range < 0)
+        {
+            hpack_encoder::add_status(head, 416);
+            hpack_encoder::add_field(head, "content-length", 14, "0", 1);
+            int len = snprintf(value, sizeof(value), "bytes */%lld", (long long)size);
+            hpack_encoder::add_field(head, "content-range", 13, value, len);
+            hpack_encoder::add_http1(head, date, date_len);
+            file_cache::release(entry);
+            m_h2->respond(s, head, nullptr, nullptr, 0, 0);
+            return;
+        }
+        if (range > 0)
+        {
+            const file_entry::variant &v = entry->variants[file_entry::IDENTITY];
+            hpack_encoder::add_status(head, 206);
+            int len = snprintf(value, sizeof(value), "%lld", (long long)range_len);
+            hpack_encoder::add_field(head, "content-length", 14, value, len);
+            len = snprintf(value, sizeof(value), "bytes %lld-%lld/%lld", (long long)range_start,
+                           (long long)(range_start + range_len - 1), (long long)size);
+            hpack_encoder::add_field(head, "content-range", 13, value, len);
+            hpack_encoder::add_http1(head, v.header.data() + v.fields, v.header.size() - v.fields);
+            hpack_encoder::add_http1(head, date, date_len);
+            m_h2->respond(s, head, entry, entry->address, range_start, range_len);
+            return;
+        }
+        if (size == 0)
+        {
+            hpack_encoder::add_status(head, 200);
+            int len = snprintf(value, sizeof(value), "%d", (int)sizeof(empty_page) - 1);
+            hpack_encoder::add_field(head, "content-length", 14, value, len);
+            hpack_encoder::add_http1(head, date, date_len);
+            file_cache::release(entry);
+            m_h2->respond(s, head, nullptr, empty_page, 0, sizeof(empty_page) - 1);
+            return;
+        }
+        int encoding = pick_encoding(entry);
+        const file_entry::variant &v = entry->variants[encoding];
+        hpack_encoder::add_status(head, 200);
+        hpack_encoder::add_http1(head, v.header.data(), v.header.size());
+        hpack_encoder::add_http1(head, date, date_len);
+        if (encoding != file_entry::IDENTITY)
+            m_h2->respond(s, head, entry, v.body.data(), 0, v.body.size());
+        else
+            m_h2->respond(s, head, entry, entry->address, 0, size);
+        return;
+    }
+    default:
+        page = &page_500;
+        break;
+    }
+    hpack_encoder::add_status(head, page->status);
+    hpack_encoder::add_http1(head, page->head.data(), page->head.size());
+    hpack_encoder::add_http1(head, date, date_len);
+    m_h2->respond(s, head, nullptr, page->form, 0, page->form_len);
+}
+
+//帧头、头部块与控制帧引用会话的输出缓冲；来自缓存项的内容登记到文件表并另持有一个引用，流提前结束也不影响本批发送
+void http_conn::fill_h2_batch()
+{
+    h2_segment segs[IOV_PER_RESPONSE * MAX_PIPELINE];
+    int n = m_h2->pull(segs, IOV_PER_RESPONSE * MAX_PIPELINE - m_iv_count, MAX_PIPELINE - m_file_count);
+    for (int i = 0; i < n; ++i)
+    {
+        if (segs[i].entry)
+        {
+            file_part &file = m_files[m_file_count++];
+            file_cache::retain(segs[i].entry);
+            file.entry = segs[i].entry;
+            file.offset = segs[i].offset;
+            file.iov = m_iv_count;
+        }
+        add_iovec(segs[i].base, segs[i].len);
+    }
+    m_batch_linger = !m_h2->closed();
+}
+
+//窗口用完时一批DATA的末尾常常是不满一个报文的小段，Nagle算法会把它留到客户端的延迟确认之后，
+//而客户端要收齐才发送WINDOW_UPDATE，每轮窗口都因此多等几十毫秒；HTTP/2连接关闭Nagle，合并由MSG_MORE保证
+void http_conn::start_h2()
+{
+    m_h2 = new h2_session(m_max_request);
+    int flag = 1;
+    setsockopt(m_sockfd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+void http_conn::release_h2()
+{
+    delete m_h2;
+    m_h2 = nullptr;
 }
@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <assert.h>
 #include <sys/stat.h>
@@ -19,21 +20,46 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
+#include <atomic>
 
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
+#include "../mempool/buffer_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../filecache/file_cache.h"
+#include "../compress/gzip_stream.h"
+#include "../scanner/http_scanner.h"
+#include "http_headers.h"
+#include "../http2/h2_session.h"
+#include "../router/router.h"
 
 
+struct error_page;
+
 //该类通过状态机模式高效地解析 HTTP 请求，支持 GET 和 POST 方法，能够处理静态文件请求和动态 CGI 请求（登录/注册功能）。同时，它还负责管理连接状态、处理超时和生成适当的 HTTP 响应。
-class http_conn
+class http_conn : public route_waiter
 {
 public:
-    static const int FILENAME_LEN = 200;
     static const int READ_BUFFER_SIZE = 2048;
     static const int WRITE_BUFFER_SIZE = 1024;
+    static const int MAX_PIPELINE = 8;// 流水线请求一批最多合并发送的响应数
+    static const int IOV_PER_RESPONSE = 4;// 一个响应最多由几段iovec组成：常量响应头、可变部分、常量尾部与响应体
+    static const int MAX_HEADERS = 32;// 单个请求最多的头部数，超出时返回431
+    static const int MAX_HEADER_SIZE = 256;// 单个响应写入写缓冲区的可变部分的上限：206的状态行与范围头部，或304的ETag，加上Date、Connection与空行
+    static const size_t MIN_DEFLATE_SIZE = 1024;// 小于该大小的响应体不即时压缩
+    static const size_t MAX_DEFLATE_SIZE = 1024 * 1024;// 更大的文件即时压缩占用CPU过多，直接零拷贝发送原内容
+    struct file_part //一批响应中的一个文件：持有的文件缓存项，sendfile方式下还记录已发送到的位置
+    {
+        file_entry *entry;// 文件缓存项，响应发送完后释放引用
+        off_t offset;// sendfile方式下一次发送的起始位置
+        int iov;// 文件内容在本批iovec中的下标，没有内容时为-1
+    };
+    static const int IO_BLOCK_SIZE = READ_BUFFER_SIZE + WRITE_BUFFER_SIZE +
+                                     IOV_PER_RESPONSE * MAX_PIPELINE * sizeof(struct iovec) +
+                                     MAX_PIPELINE * sizeof(file_part) +
+                                     MAX_HEADERS * sizeof(http_header);// 从缓冲块池借用的块：读缓冲 + 写缓冲 + iovec数组、文件表与头部表
     enum METHOD //表示 HTTP 请求方法，包括常见的 GET、POST 等方法。
     {
         GET = 0,
@@ -60,7 +86,11 @@ public:
         NO_RESOURCE,// 没有资源
         FORBIDDEN_REQUEST,// 权限不足
         FILE_REQUEST,// 文件请求
+        NOT_MODIFIED,// 条件请求匹配，客户端的缓存仍然有效
         INTERNAL_ERROR,// 服务器内部错误
+        HEADER_TOO_LARGE,// 请求行和头部超出单个请求的上限
+        BODY_TOO_LARGE,// 请求体超出单个请求的上限
+        PENDING_REQUEST,// 处理器在等待数据库查询，请求挂起，结果由执行线程交回后继续
         CLOSED_CONNECTION// 客户端已关闭连接
     };
     enum LINE_STATUS //表示从缓冲区中读取一行的状态。
@@ -69,14 +99,32 @@ public:
         LINE_BAD,// 行出错
         LINE_OPEN// 行数据尚不完整
     };
+    enum CHUNK_STATE //chunked请求体的解码进度
+    {
+        CHUNK_SIZE = 0,// 等待块长度行
+        CHUNK_DATA,// 读取块数据
+        CHUNK_DATA_END,// 块数据之后的CRLF
+        CHUNK_TRAILER// 0长度块之后的尾部头部，空行结束
+    };
+    enum TIMEOUT_STATE //表示连接当前所处的阶段，不同阶段使用不同的超时时间。
+    {
+        TIMEOUT_HEADER = 0,// 正在读取请求行和头部
+        TIMEOUT_BODY,// 正在读取请求体
+        TIMEOUT_KEEPALIVE,// 长连接空闲，等待下一个请求
+        TIMEOUT_WRITE,// 响应尚未发送完毕
+        TIMEOUT_PENDING// 请求挂起，等待数据库查询的结果
+    };
 
 public:
-    http_conn() {}
+    http_conn() : m_sockfd(-1), m_block(nullptr), m_segments(nullptr), m_read_buf(nullptr), m_write_buf(nullptr),
+                  m_file(nullptr), m_iv(nullptr), m_iv_count(0), m_files(nullptr), m_file_count(0), m_stream(nullptr), m_h2(nullptr),
+                  m_in_pool(false), m_generation(0), m_parked(false), m_job(nullptr) {}
     ~http_conn() {}
 
 public:
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);//初始化 HTTP 连接，设置 socket、地址、根目录、触发模式、日志开关、数据库信息等。
-    void close_conn(bool real_close = true);//关闭连接，real_close 表示是否真正关闭连接。
+    void init(int sockfd, const sockaddr_in &addr, char *, int, int, int epollfd);//初始化 HTTP 连接，设置 socket、地址、根目录、触发模式、日志开关以及所属反应堆的epoll实例。
+    void close_conn();//关闭连接：从epoll中移除并关闭socket，之后该对象留给复用该fd的新连接
+    void release_closed();//连接已关闭且不在工作线程中时，归还缓冲块、文件缓存项与HTTP/2会话
     void process();//处理 HTTP 请求的入口函数。
     bool read_once();//读取客户端数据
     bool write();//向客户端写入数据。
@@ -84,81 +132,155 @@ public:
     {
         return &m_address;
     }
-    void initmysql_result(connection_pool *connPool);//初始化数据库查询结果，将用户名和密码加载到内存中。
-    int timer_flag;// 定时器标志，表示该定时器是否需要被删除，0表示不需要，1表示需要。
-    int improv;// 改进标志
+    int get_sockfd() const//获取连接的socket，连接已关闭时为-1。
+    {
+        return m_sockfd;
+    }
+    unsigned generation() const { return m_generation; }//连接的代数，关闭时递增
+    TIMEOUT_STATE timeout_state() const;//根据读写进度判断连接所处阶段，供事件循环选择超时时间。
+
+    //io_uring后端使用：读写由环完成，连接只负责缓冲区与发送进度
+    bool append_input(const char *data, int len);//将环上收到的数据追加到读缓冲区，缓冲区满时与read_once一样扩展
+    struct msghdr *pending_output();//待发送响应对应的msghdr，指向当前的iovec
+    int consume_output(int bytes);//记录已发送的字节并调整iovec，返回剩余待发送字节数
+    bool finish_output();//一批响应发送完毕：释放文件缓存项，长连接保留尚未处理的请求数据、重置其余状态并返回true，否则返回false
+    //上一批响应已发送完，读缓冲区中还有因批次已满而未解析的请求，或挂起的请求已得到结果（本批之前的响应与它一起发送），
+    //应直接交给线程池而不是等待读事件
+    bool has_pending_request() const
+    {
+        return m_read_pending && (bytes_to_send == 0 || m_parked);
+    }
+    void resume(unsigned generation, const char *target);//执行线程交回挂起请求的结果，经写事件把连接交给线程池
+    //Reactor模式的工作线程处理期间把要重新注册的事件记在这里（-1表示不推迟，直接注册），
+    //连同超时阶段投递给事件循环，由事件循环调整定时器后再注册
+    static thread_local int t_rearm_ev;
+    void rearm(int ev);//重新注册读/写事件，epoll后端修改EPOLLONESHOT事件，io_uring后端通知环
+    completion_queue *m_cq;// 工作线程处理完后，通过它通知连接所属的事件循环
 
 
 private:
     void init();//初始化 HTTP 连接的各个状态变量。
     HTTP_CODE process_read();//这些函数用于解析 HTTP 请求，采用状态机模式。
     bool process_write(HTTP_CODE ret);//这些函数用于解析 HTTP 请求，采用状态机模式。
-    HTTP_CODE parse_request_line(char *text);//这些函数用于解析 HTTP 请求，采用状态机模式。
-    HTTP_CODE parse_headers(char *text);//这些函数用于解析 HTTP 请求，采用状态机模式。
+    HTTP_CODE parse_request_line(char *text, long len);//这些函数用于解析 HTTP 请求，采用状态机模式。
+    HTTP_CODE parse_headers(char *text, long len);//这些函数用于解析 HTTP 请求，采用状态机模式。
     HTTP_CODE parse_content(char *text);//这些函数用于解析 HTTP 请求，采用状态机模式。
     HTTP_CODE do_request();//这些函数用于解析 HTTP 请求，采用状态机模式。
+    HTTP_CODE serve_file(const char *url);//处理器给出目标文件后：条件请求与文件缓存
+    void start_job();//请求已挂起，提交处理器留下的后续工作；之后结果随时可能交回，调用者不能再访问连接
+    char *header(int id);//按HEADER_ID取得头部的取值（以'\0'结尾），请求中没有该头部时返回空
+    bool not_modified(const struct stat &st, const file_entry *entry);//条件请求是否满足，entry为空时按stat生成的ETag比较
+    int parse_range(const file_entry *entry, off_t &start, off_t &len);//解析Range与If-Range，1为可满足的单个范围，0为忽略，-1为不可满足
     char *get_line() { return m_read_buf + m_start_line; };//这些函数用于解析 HTTP 请求，采用状态机模式。
     LINE_STATUS parse_line();//这些函数用于解析 HTTP 请求，采用状态机模式。
-    void unmap();//这些函数用于生成 HTTP 响应。
-    bool add_response(const char *format, ...);//这些函数用于生成 HTTP 响应。
-    bool add_content(const char *content);//这些函数用于生成 HTTP 响应。
-    bool add_status_line(int status, const char *title);//这些函数用于生成 HTTP 响应。
-    bool add_headers(int content_length);//这些函数用于生成 HTTP 响应。
-    bool add_content_type();//这些函数用于生成 HTTP 响应。
-    bool add_content_length(int content_length);//这些函数用于生成 HTTP 响应。
-    bool add_linger();//这些函数用于生成 HTTP 响应。
-    bool add_blank_line();//这些函数用于生成 HTTP 响应。
+    void release_files();//释放本批响应中文件缓存项的引用与即时压缩的输出
+    int send_output();//发送本批响应中从当前位置开始的一段数据
+    body_stream *deflate_body(const char *data, int fd, size_t len);//开始即时压缩响应体，不适合压缩或没有可用的压缩器时返回空
+    bool next_chunk();//从m_stream取得下一段内容，按chunked编码登记到iovec；内容结束时追加0长度块并释放m_stream
+    HTTP_CODE parse_chunked(char *body);//在请求体原处解码chunked编码，数据分多次读入时从上次的位置继续
+    bool add_text(const char *text, int len);//向写缓冲区追加响应中的可变部分，与上一段写缓冲区中的数据相邻时合并为一段iovec
+    bool add_number(long long value);//追加十进制整数，不经过printf
+    bool add_tail();//追加Date、Connection与结束响应头的空行
+    bool add_error(const error_page &page);//预先序列化的错误响应，只补Date与Connection
+    void attach_buffers();//有请求数据到达时从缓冲块池借用读写缓冲
+    void release_buffers();//连接空闲或读取失败时归还缓冲块
+    bool grow_read_buffer();//读缓冲区已满时换到更大的新分段，超出单个请求上限时返回false
+    void free_segments();//释放本次请求分配的全部分段
+    void next_request();//当前请求的响应已生成，解析位置移到请求末尾，准备解析流水线中的下一个请求
+    void reset_output();//清空写缓冲区、iovec与文件映射表
+    bool batch_has_room() const;//本批次还能否再追加一个响应
+    void add_iovec(const char *base, int len);//向本批次追加一段待发送数据，常量部分与缓存项中的响应头直接引用不复制
+    int pick_encoding(const file_entry *entry) const;//客户端接受且缓存项中有的压缩版本，优先brotli，都没有时为IDENTITY
+    long input_limit() const;//读缓冲区中待解析数据的上限，HTTP/2连接还要容纳一个接收窗口的DATA
+
+    //HTTP/2（h2c）
+    bool h2_preface() const;//读缓冲区开头是HTTP/2的连接前言（prior knowledge）
+    bool h2_upgrade_requested();//请求带Upgrade: h2c与HTTP2-Settings且没有请求体
+    bool upgrade_h2(HTTP_CODE ret);//回复101并切换到HTTP/2，升级请求的响应作为流1发送；HTTP2-Settings不合法时返回false
+    void process_h2();//HTTP/2连接的处理入口：解析帧，处理完整的请求，排好下一批帧
+    bool serve_h2(h2_stream *s);//把流中的请求填入解析状态，按HTTP/1.1相同的do_request处理，请求挂起时返回false
+    void respond_h2(HTTP_CODE ret, h2_stream *s);//把处理结果编码为HPACK头部块，登记响应体
+    void fill_h2_batch();//把会话排好的帧登记为本批的iovec与文件表
+    void start_h2();
+    void release_h2();//连接关闭或复用时释放HTTP/2会话
 
 public:
-    static int m_epollfd;// 所有连接共享的epoll文件描述符
-    static int m_user_count;// 统计用户数量
-    MYSQL *mysql;  // 数据库连接
+    static std::atomic<int> m_user_count;// 统计用户数量，多个反应堆线程并发更新
+    int m_epollfd;// 该连接所属反应堆的epoll文件描述符
     int m_state;  //读为0, 写为1
+    std::atomic<bool> m_in_pool;// 已交给线程池，工作线程尚未处理完；此时连接被关闭，由完成通知到达时再归还资源
+    static buffer_pool m_buffer_pool;// 所有连接共享的缓冲块池
+    static long m_max_request;// 单个请求（请求行、头部与请求体）的最大字节数
+    static bool m_sendfile;// 静态文件用sendfile零拷贝发送，false时使用mmap + writev
+    static bool m_http2;// 接受HTTP/2（h2c）的连接前言与Upgrade
 
 private:
     int m_sockfd;// 该HTTP连接的socket
     sockaddr_in m_address;// 通信的socket地址
 
 
-    //缓冲区相关,这些变量管理读写缓冲区及其状态
-    char m_read_buf[READ_BUFFER_SIZE]; // 读缓冲区
+    //缓冲区相关,这些变量管理读写缓冲区及其状态，三个缓冲区都指向借用的缓冲块，空闲时为空
+    char *m_block;// 从缓冲块池借用的缓冲块
+    char *m_segments;// 请求超出缓冲块中的读缓冲后分配的分段链表，每段开头存放上一段的地址，最新的分段在表头
+    char *m_read_buf; // 读缓冲区，指向缓冲块或最新的分段
+    long m_read_size;// 当前读缓冲区的容量
+    long m_parsed_bytes;// 本次请求留在之前分段中的已解析字节数，流水线中请求从当前分段中间开始时为负的起始位置
+    HTTP_CODE m_read_error;// 读取时超出单个请求上限则记录为HEADER_TOO_LARGE或BODY_TOO_LARGE
     long m_read_idx;// 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
     long m_checked_idx;// 当前正在分析的字符在读缓冲区中的位置
+    long m_line_len;// parse_line解析出的当前行长度，不含CRLF
     int m_start_line; // 当前正在解析的行的起始位置
-    char m_write_buf[WRITE_BUFFER_SIZE];// 写缓冲区
+    char *m_write_buf;// 写缓冲区
     int m_write_idx;// 写缓冲区中待发送的字节数
 
     //解析状态相关,这些变量用于维护 HTTP 请求解析的状态
     CHECK_STATE m_check_state; // 当前主状态机的状态
     METHOD m_method;// 请求方法
-    char m_real_file[FILENAME_LEN];// 客户请求的目标文件的完整路径
     char *m_url;// 请求目标文件的文件名
     char *m_version;// 协议版本
-    char *m_host;// 主机名
     long m_content_length;// HTTP请求的消息总长度
     bool m_linger;// HTTP请求是否要保持连接
+    int m_accept_encoding;// Accept-Encoding中客户端接受的压缩方式，按file_entry::ENCODING的位组合
+    char m_etag[64];// 304响应带的ETag
+    http_header *m_headers;// 本次请求的头部表，指向缓冲块中的数组，按出现顺序排列
+    int m_header_count;// 头部表中的头部数
+    signed char m_header_index[HEADER_COUNT];// 已知头部在头部表中的下标，没有时为-1，同名头部取最后一个
 
 
     //文件相关,这些变量用于管理请求的文件和发送操作
-    char *m_file_address;// 客户请求的目标文件被mmap到内存中的起始位置
-    struct stat m_file_stat;// 目标文件的状态
-    struct iovec m_iv[2]; // 采用writev来执行写操作
+    file_entry *m_file;// do_request从文件缓存取得的目标文件，process_write将它登记到文件表
+    struct iovec *m_iv; // 采用writev来执行写操作，指向缓冲块中的数组，一批响应的头部与文件内容依次排列，sendfile发送的文件内容iov_base为空
     int m_iv_count;// 表示被写内存块的数量
+    int m_iv_index;// 第一个尚未发送完的内存块
+    file_part *m_files;// 本批响应中的文件，发送完后逐个释放
+    int m_file_count;// 文件的数量
+    int m_file_index;// sendfile方式下正在发送的文件
+    body_stream *m_stream;// 本批最后一个响应分段生成的响应体，当前一段发送完后再生成下一段，为空表示没有
+    std::string m_chunk;// 正在发送的一段（已按chunked编码），响应结束后释放
+    bool m_batch_linger;// 本批最后一个响应是否保持连接
+    h2_session *m_h2;// HTTP/2连接的会话，HTTP/1.1连接为空
+    bool m_read_pending;// 批次已满时读缓冲区中还剩未解析的数据，或挂起的请求已得到结果
+    std::atomic<unsigned> m_generation;// 连接关闭时递增，挂起请求的结果据此判断连接是否还是原来的连接
+    locker m_close_lock;// 保护关闭、fd复用与挂起请求交回结果之间的先后
+    bool m_parked;// 当前请求挂起，等待处理器的后续工作给出结果
+    const char *m_route_target;// 挂起请求的结果：要发送的文件，为空表示没有资源
+    route_job *m_job;// 处理器留下、尚未提交的后续工作
+    h2_stream *m_parked_stream;// HTTP/2连接上挂起请求所在的流
+    struct msghdr m_msg;// io_uring后端提交sendmsg时使用
 
     
-    int cgi;        //是否启用的POST
     char *m_string; //存储请求头数据
+    char m_content_next;// 请求体之后的一个字节，parse_content写入'\0'前保存，流水线中它属于下一个请求
+    bool m_chunked;// 请求体使用chunked编码
+    int m_chunk_state;// chunked请求体的解码进度，见CHUNK_STATE
+    long m_chunk_pos;// 下一个待解码字节相对请求体起始处的偏移，读缓冲区换到新分段时不变
+    long m_chunk_remain;// 当前块中尚未读入的数据长度
     int bytes_to_send;// 剩余要发送的字节数
     int bytes_have_send; // 已经发送的字节数
     char *doc_root;// 网站根目录
 
-    map<string, string> m_users;// 存储用户名和密码
     int m_TRIGMode;// 触发模式
     int m_close_log;// 日志开关
-
-    char sql_user[100];// 数据库用户名
-    char sql_passwd[100];// 数据库密码
-    char sql_name[100];// 数据库名
 };
 
 #endif
@@ -0,0 +1,125 @@
+#ifndef HTTP_HEADERS_H
+#define HTTP_HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//已知请求头部名称的完美哈希表：与MIME类型表相同，哈希表在编译期构造，static_assert保证名称互不冲突，
+//识别一个头部只计算一次小写哈希并比较一个槽。增加名称后若编译报冲突，重新选择HEADER_HASH_SEED即可
+enum HEADER_ID
+{
+    HEADER_CONNECTION = 0,
+    HEADER_CONTENT_LENGTH,
+    HEADER_HOST,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE,
+    HEADER_USER_AGENT,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_LANGUAGE,
+    HEADER_COOKIE,
+    HEADER_REFERER,
+    HEADER_CONTENT_TYPE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_UPGRADE,
+    HEADER_CACHE_CONTROL,
+    HEADER_ORIGIN,
+    HEADER_EXPECT,
+    HEADER_AUTHORIZATION,
+    HEADER_PRAGMA,
+    HEADER_TE,
+    HEADER_HTTP2_SETTINGS,
+    HEADER_COUNT,
+    HEADER_UNKNOWN = HEADER_COUNT// 不在表中的头部
+};
+
+static constexpr const char *HEADER_NAMES[HEADER_COUNT] = {
+    "connection", "content-length", "host", "accept-encoding", "if-none-match", "if-modified-since",
+    "range", "if-range", "user-agent", "accept", "accept-language", "cookie",
+    "referer", "content-type", "transfer-encoding", "upgrade", "cache-control", "origin",
+    "expect", "authorization", "pragma", "te", "http2-settings",
+};
+
+//请求中的一个头部：名称与取值都指向读缓冲区，不复制；取值已去掉两端的空白
+struct http_header
+{
+    char *name;
+    char *value;
+    int value_len;
+    unsigned short name_len;
+    unsigned char id;// HEADER_ID，未知头部为HEADER_UNKNOWN
+};
+
+static constexpr int HEADER_TABLE_SIZE = 64;
+static constexpr uint32_t HEADER_HASH_SEED = 83;
+
+//FNV-1a，取高位作为槽号；大写字母先转小写
+constexpr int header_hash(const char *name, size_t len)
+{
+    uint32_t h = HEADER_HASH_SEED;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = name[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        h = (h ^ c) * 16777619u;
+    }
+    return (h >> 24) % HEADER_TABLE_SIZE;
+}
+
+constexpr size_t header_strlen(const char *s)
+{
+    size_t n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
+
+struct header_table
+{
+    signed char slot[HEADER_TABLE_SIZE];// 槽中是HEADER_ID，空槽为-1
+    unsigned char len[HEADER_COUNT];// 各名称的长度，先比较长度再比较字节
+    bool perfect;// 没有两个名称落在同一个槽
+};
+
+constexpr header_table build_header_table()
+{
+    header_table table{};
+    table.perfect = true;
+    for (int i = 0; i < HEADER_TABLE_SIZE; ++i)
+        table.slot[i] = -1;
+    for (int i = 0; i < HEADER_COUNT; ++i)
+    {
+        table.len[i] = header_strlen(HEADER_NAMES[i]);
+        int h = header_hash(HEADER_NAMES[i], table.len[i]);
+        if (table.slot[h] != -1)
+            table.perfect = false;
+        table.slot[h] = i;
+    }
+    return table;
+}
+
+static constexpr header_table HEADER_TABLE = build_header_table();
+static_assert(HEADER_TABLE.perfect, "header names collide, choose another HEADER_HASH_SEED");
+
+//按名称（不区分大小写，不含':'）识别头部，不在表中时返回HEADER_UNKNOWN
+inline int header_id_of(const char *name, size_t len)
+{
+    int id = HEADER_TABLE.slot[header_hash(name, len)];
+    if (id < 0 || HEADER_TABLE.len[id] != len)
+        return HEADER_UNKNOWN;
+    const char *known = HEADER_NAMES[id];
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = name[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != (unsigned char)known[i])
+            return HEADER_UNKNOWN;
+    }
+    return id;
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "http_routes.h"
+
+#include <string.h>
+#include <map>
+#include <set>
+#include <string>
+#include "../lock/locker.h"
+#include "../log/log.h"
+#include "../CGImysql/sql_executor.h"
+
+using namespace std;
+
+static locker m_lock;//保护用户数据的互斥锁
+static map<string, string> users;//存储用户名和密码的映射，用于用户认证
+static set<string> registering;//正在插入数据库的用户名，防止同名注册重复插入
+
+void load_users(connection_pool *connPool, int close_log)
+{
+    int m_close_log = close_log;
+    //先从连接池中取一个连接
+    MYSQL *mysql = nullptr;
+    connectionRAII mysqlcon(&mysql, connPool);
+
+    //在user表中检索username，passwd数据，浏览器端输入
+    if (mysql_query(mysql, "SELECT username,passwd FROM user"))
+    {
+        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
+        return;
+    }
+
+    //从表中检索完整的结果集
+    MYSQL_RES *result = mysql_store_result(mysql);
+
+    //从结果集中获取下一行，将对应的用户名和密码，存入map中
+    while (MYSQL_ROW row = mysql_fetch_row(result))
+        users[row[0]] = row[1];
+    mysql_free_result(result);
+}
+
+//固定页面：目标文件在注册时给出，如"/0"对应注册页面
+class page_handler : public route_handler
+{
+public:
+    explicit page_handler(const char *target) : m_target(target) {}
+    const char *handle(route_request &) { return m_target; }
+
+private:
+    const char *m_target;
+};
+
+//静态文件：URL即网站根目录下的路径
+class file_handler : public route_handler
+{
+public:
+    const char *handle(route_request &req) { return req.path; }
+};
+
+//登录与注册的数据库部分：处理器把表单拷贝进任务后立即返回PENDING，连接挂起请求后任务才提交到执行器，
+//执行线程上查询，得出结果页面后交回连接；m_lock只在读写内存中的用户表时持有，不跨越查询
+class user_job : public route_job, public sql_task
+{
+public:
+    static const int FIELD_SIZE = 100;
+
+    user_job(route_request &req, const char *name, const char *password, int close_log)
+        : m_waiter(req.waiter), m_generation(req.generation), m_close_log(close_log)
+    {
+        strcpy(m_name, name);
+        strcpy(m_password, password);
+    }
+
+    void start() { sql_executor::get_instance()->submit(this); }
+
+    void run(connectionRAII &con)
+    {
+        const char *target = query(con);
+        m_waiter->resume(m_generation, target);
+    }
+
+protected:
+    virtual const char *query(connectionRAII &con) = 0;
+
+    //执行连接上准备好的语句，参数依次绑定为字符串；成功时返回语句，由调用者取结果，语句留在连接上不关闭。
+    //执行时连接已断开则重连（连接上的语句随之重新准备）后重试一次
+    MYSQL_STMT *execute(connectionRAII &con, int id, const char **params, int count)
+    {
+        if (!con.connection())
+        {
+            LOG_ERROR("%s", "no database connection");
+            return nullptr;
+        }
+        MYSQL_BIND bind[2];
+        memset(bind, 0, sizeof(bind));
+        for (int i = 0; i < count; ++i)
+        {
+            bind[i].buffer_type = MYSQL_TYPE_STRING;
+            bind[i].buffer = (void *)params[i];
+            bind[i].buffer_length = strlen(params[i]);
+        }
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            MYSQL_STMT *stmt = con.statement(id);
+            if (!stmt)
+                return nullptr;
+            if (mysql_stmt_bind_param(stmt, bind) == 0 && mysql_stmt_execute(stmt) == 0)
+                return stmt;
+            LOG_ERROR("mysql_stmt failed: %s", mysql_stmt_error(stmt));
+            if (!connection_pool::ConnectionLost(stmt) || !con.reconnect())
+                break;
+        }
+        return nullptr;
+    }
+
+protected:
+    route_waiter *m_waiter;
+    unsigned m_generation;
+    int m_close_log;
+    char m_name[FIELD_SIZE];
+    char m_password[FIELD_SIZE];
+};
+
+//登录与注册共用的表单解析；内存中已能判断结果的请求与静态文件一样立即返回，不占用数据库连接
+class user_handler : public route_handler
+{
+public:
+    static const int FIELD_SIZE = user_job::FIELD_SIZE;
+
+    explicit user_handler(int close_log) : m_close_log(close_log) {}
+
+protected:
+    //表单"user=...&password=..."中取出用户名和密码，格式不符或超出长度时返回false
+    static bool parse_form(const char *body, char *name, char *password)
+    {
+        if (!body || strncmp(body, "user=", 5) != 0)
+            return false;
+        const char *amp = strchr(body + 5, '&');
+        if (!amp || amp - body - 5 >= FIELD_SIZE || strncmp(amp + 1, "password=", 9) != 0)
+            return false;
+        size_t len = strlen(amp + 10);
+        if (len >= (size_t)FIELD_SIZE)
+            return false;
+        memcpy(name, body + 5, amp - body - 5);
+        name[amp - body - 5] = '\0';
+        memcpy(password, amp + 10, len + 1);
+        return true;
+    }
+
+protected:
+    int m_close_log;
+};
+
+//注册的插入：成功后写入内存，无论成败都释放对用户名的占用
+class register_job : public user_job
+{
+public:
+    register_job(route_request &req, const char *name, const char *password, int close_log)
+        : user_job(req, name, password, close_log) {}
+
+protected:
+    const char *query(connectionRAII &con)
+    {
+        // 使用预处理语句防止SQL注入
+        const char *params[2] = {m_name, m_password};
+        MYSQL_STMT *stmt = execute(con, STMT_INSERT_USER, params, 2);
+        m_lock.lock();
+        if (stmt)
+            users[m_name] = m_password;// 更新内存
+        registering.erase(m_name);
+        m_lock.unlock();
+        return stmt ? "/log.html" : "/registerError.html";
+    }
+};
+
+//注册：内存中没有重名用户、也没有正在注册的同名请求时占用用户名，插入数据库后跳转到登录页面
+class register_handler : public user_handler
+{
+public:
+    explicit register_handler(int close_log) : user_handler(close_log) {}
+
+    const char *handle(route_request &req)
+    {
+        char name[FIELD_SIZE], password[FIELD_SIZE];
+        if (!parse_form(req.body, name, password))
+            return "/registerError.html";
+
+        m_lock.lock();
+        bool taken = users.find(name) != users.end() || !registering.insert(name).second;
+        m_lock.unlock();
+        if (taken)
+            return "/registerError.html";
+        req.job = new register_job(req, name, password, m_close_log);
+        return PENDING;
+    }
+};
+
+//登录的查询：数据库中的密码一致时写入内存
+class login_job : public user_job
+{
+public:
+    login_job(route_request &req, const char *name, const char *password, int close_log)
+        : user_job(req, name, password, close_log) {}
+
+protected:
+    const char *query(connectionRAII &con)
+    {
+        const char *params[1] = {m_name};
+        bool ok = false;
+        MYSQL_STMT *stmt = execute(con, STMT_SELECT_PASSWD, params, 1);
+        if (stmt)
+        {
+            char db_password[FIELD_SIZE];
+            unsigned long password_length = 0;
+            MYSQL_BIND result;
+            memset(&result, 0, sizeof(result));
+            result.buffer_type = MYSQL_TYPE_STRING;
+            result.buffer = db_password;
+            result.buffer_length = sizeof(db_password);
+            result.length = &password_length;
+            if (mysql_stmt_bind_result(stmt, &result) != 0)
+            {
+                LOG_ERROR("mysql_stmt_bind_result failed: %s", mysql_stmt_error(stmt));
+            }
+            else if (mysql_stmt_fetch(stmt) == 0 && password_length < sizeof(db_password))
+            {
+                db_password[password_length] = '\0';
+                ok = strcmp(db_password, m_password) == 0;
+            }
+            mysql_stmt_free_result(stmt);// 丢弃未读的行，语句下次可直接执行
+        }
+        if (ok)
+        {
+            m_lock.lock();
+            users[m_name] = m_password;
+            m_lock.unlock();
+        }
+        return ok ? "/welcome.html" : "/logError.html";
+    }
+};
+
+//登录：先在内存中验证，未命中时交给执行器查询数据库，验证通过后更新内存
+class login_handler : public user_handler
+{
+public:
+    explicit login_handler(int close_log) : user_handler(close_log) {}
+
+    const char *handle(route_request &req)
+    {
+        char name[FIELD_SIZE], password[FIELD_SIZE];
+        if (!parse_form(req.body, name, password))
+            return "/logError.html";
+
+        m_lock.lock();
+        auto it = users.find(name);
+        bool ok = it != users.end() && it->second == password;
+        m_lock.unlock();
+        if (ok)
+            return "/welcome.html";
+        req.job = new login_job(req, name, password, m_close_log);
+        return PENDING;
+    }
+};
+
+void init_routes(router *r, int close_log)
+{
+    //登录页面的表单与链接指向这些短路径
+    static const struct
+    {
+        const char *path;
+        const char *target;
+    } pages[] = {
+        {"/", "/judge.html"},
+        {"/0", "/register.html"},
+        {"/1", "/log.html"},
+        {"/5", "/picture.html"},
+        {"/6", "/video.html"},
+        {"/7", "/fans.html"},
+    };
+    for (const auto &page : pages)
+    {
+        page_handler *handler = new page_handler(page.target);
+        r->add(ROUTE_GET, page.path, handler);
+        r->add(ROUTE_POST, page.path, handler);
+    }
+    r->add(ROUTE_POST, "/2CGISQL.cgi", new login_handler(close_log));
+    r->add(ROUTE_POST, "/3CGISQL.cgi", new register_handler(close_log));
+
+    //其余路径都是网站根目录下的文件，POST到页面时同样返回页面本身
+    file_handler *files = new file_handler;
+    r->add(ROUTE_GET, "/*", files);
+    r->add(ROUTE_POST, "/*", files);
+    r->compile();
+}
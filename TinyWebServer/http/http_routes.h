@@ -0,0 +1,14 @@
+#ifndef HTTP_ROUTES_H
+#define HTTP_ROUTES_H
+
+#include "../router/router.h"
+#include "../CGImysql/sql_connection_pool.h"
+
+//网站的路由：页面映射、登录与注册在这里注册到路由表并编译，新增接口只需实现一个处理器并在init_routes中注册
+//登录、注册需要查询数据库时交给sql_executor执行，工作线程不等待查询结果
+void init_routes(router *r, int close_log);
+
+//把数据库中的用户名和密码读入内存，登录时先查内存
+void load_users(connection_pool *connPool, int close_log);
+
+#endif
@@ -0,0 +1,643 @@
+#include <string.h>
+
+#include "h2_session.h"
+
+//帧类型与标志
+enum
+{
+    FRAME_DATA = 0,
+    FRAME_HEADERS,
+    FRAME_PRIORITY,
+    FRAME_RST_STREAM,
+    FRAME_SETTINGS,
+    FRAME_PUSH_PROMISE,
+    FRAME_PING,
+    FRAME_GOAWAY,
+    FRAME_WINDOW_UPDATE,
+    FRAME_CONTINUATION
+};
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+//SETTINGS参数
+enum
+{
+    SETTINGS_HEADER_TABLE_SIZE = 1,
+    SETTINGS_ENABLE_PUSH,
+    SETTINGS_MAX_CONCURRENT_STREAMS,
+    SETTINGS_INITIAL_WINDOW_SIZE,
+    SETTINGS_MAX_FRAME_SIZE,
+    SETTINGS_MAX_HEADER_LIST_SIZE
+};
+
+static const long MAX_WINDOW = 0x7fffffff;
+
+const char h2_session::PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+static uint32_t get32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put32(std::string &out, uint32_t v)
+{
+    out += (char)(v >> 24);
+    out += (char)(v >> 16);
+    out += (char)(v >> 8);
+    out += (char)v;
+}
+
+//服务器的连接前言：SETTINGS，只通告与默认值不同的参数
+h2_session::h2_session(long max_request)
+    : m_max_request(max_request), m_last_stream(0), m_turn(0), m_preface(false), m_settings(false), m_failed(false),
+      m_peer_goaway(false), m_block_stream(0), m_block_end_stream(false), m_send_window(WINDOW_SIZE),
+      m_recv_window(WINDOW_SIZE), m_peer_window(WINDOW_SIZE), m_peer_frame(MAX_FRAME_SIZE)
+{
+    add_frame(m_control, 12, FRAME_SETTINGS, 0, 0);
+    m_control += (char)0;
+    m_control += (char)SETTINGS_MAX_CONCURRENT_STREAMS;
+    put32(m_control, MAX_STREAMS);
+    m_control += (char)0;
+    m_control += (char)SETTINGS_MAX_HEADER_LIST_SIZE;
+    put32(m_control, max_request);
+}
+
+h2_session::~h2_session()
+{
+    while (!m_streams.empty())
+        release_stream(m_streams.begin());
+}
+
+void h2_session::add_frame(std::string &out, uint32_t len, uint8_t type, uint8_t flags, uint32_t id)
+{
+    out += (char)(len >> 16);
+    out += (char)(len >> 8);
+    out += (char)len;
+    out += (char)type;
+    out += (char)flags;
+    put32(out, id);
+}
+
+void h2_session::add_window_update(uint32_t id, uint32_t increment)
+{
+    add_frame(m_control, 4, FRAME_WINDOW_UPDATE, 0, id);
+    put32(m_control, increment);
+}
+
+void h2_session::fail(ERROR_CODE code)
+{
+    if (m_failed)
+        return;
+    m_failed = true;
+    add_frame(m_control, 8, FRAME_GOAWAY, 0, 0);
+    put32(m_control, m_last_stream);
+    put32(m_control, code);
+}
+
+void h2_session::release_stream(std::map<uint32_t, h2_stream>::iterator it)
+{
+    if (it->second.entry)
+        file_cache::release(it->second.entry);
+    m_streams.erase(it);
+}
+
+void h2_session::reset_stream(uint32_t id, ERROR_CODE code)
+{
+    add_frame(m_control, 4, FRAME_RST_STREAM, 0, id);
+    put32(m_control, code);
+    auto it = m_streams.find(id);
+    if (it != m_streams.end())
+        release_stream(it);
+}
+
+h2_stream &h2_session::open_stream(uint32_t id)
+{
+    h2_stream &s = m_streams[id];
+    s.id = id;
+    s.list_size = 0;
+    s.request_done = false;
+    s.too_large = false;
+    s.send_window = m_peer_window;
+    s.recv_window = WINDOW_SIZE;
+    s.responded = false;
+    s.head_sent = false;
+    s.entry = nullptr;
+    s.data = nullptr;
+    s.offset = 0;
+    s.remaining = 0;
+    m_last_stream = id;
+    return s;
+}
+
+//HTTP2-Settings用base64url编码（不带填充），也接受标准base64的字符与填充
+h2_stream *h2_session::upgrade(const char *settings)
+{
+    std::string payload;
+    uint32_t bits = 0;
+    int count = 0;
+    for (const char *p = settings; *p && *p != '='; ++p)
+    {
+        int v;
+        if (*p >= 'A' && *p <= 'Z')
+            v = *p - 'A';
+        else if (*p >= 'a' && *p <= 'z')
+            v = *p - 'a' + 26;
+        else if (*p >= '0' && *p <= '9')
+            v = *p - '0' + 52;
+        else if (*p == '-' || *p == '+')
+            v = 62;
+        else if (*p == '_' || *p == '/')
+            v = 63;
+        else
+            return nullptr;
+        bits = bits << 6 | v;
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            payload += (char)(bits >> count);
+        }
+    }
+    if (payload.size() % 6 != 0 || !apply_settings((const unsigned char *)payload.data(), payload.size()))
+        return nullptr;
+    h2_stream &s = open_stream(1);
+    s.request_done = true;
+    return &s;
+}
+
+bool h2_session::input_ready(const char *buf, long len) const
+{
+    if (m_failed)
+        return false;
+    if (!m_preface)
+        return len >= PREFACE_LEN;
+    if (len < FRAME_HEADER)
+        return false;
+    const unsigned char *p = (const unsigned char *)buf;
+    uint32_t length = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return length > MAX_FRAME_SIZE || len >= FRAME_HEADER + (long)length;
+}
+
+long h2_session::receive(const char *buf, long len)
+{
+    if (m_failed)
+        return len;// 已发送GOAWAY，之后的数据全部丢弃
+    long used = 0;
+    if (!m_preface)
+    {
+        long n = len < PREFACE_LEN ? len : PREFACE_LEN;
+        if (memcmp(buf, PREFACE, n) != 0)
+        {
+            fail(PROTOCOL_ERROR);
+            return len;
+        }
+        if (len < PREFACE_LEN)
+            return 0;
+        m_preface = true;
+        used = PREFACE_LEN;
+    }
+    while (len - used >= FRAME_HEADER && !m_failed)
+    {
+        const unsigned char *p = (const unsigned char *)buf + used;
+        uint32_t length = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+        if (length > MAX_FRAME_SIZE)
+        {
+            fail(FRAME_SIZE_ERROR);
+            break;
+        }
+        if (len - used < FRAME_HEADER + (long)length)
+            break;
+        used += FRAME_HEADER + length;
+        handle_frame(p[3], p[4], get32(p + 5) & 0x7fffffff, p + FRAME_HEADER, length);
+    }
+    return m_failed ? len : used;
+}
+
+void h2_session::handle_frame(uint8_t type, uint8_t flags, uint32_t id, const unsigned char *p, uint32_t len)
+{
+    //连接前言之后的第一帧必须是SETTINGS；头部块未结束时只能是同一个流的CONTINUATION
+    if (!m_settings && type != FRAME_SETTINGS)
+        return fail(PROTOCOL_ERROR);
+    if (m_block_stream && (type != FRAME_CONTINUATION || id != m_block_stream))
+        return fail(PROTOCOL_ERROR);
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        return on_data(flags, id, p, len);
+    case FRAME_HEADERS:
+        return on_headers(flags, id, p, len);
+    case FRAME_PRIORITY:
+        //不按优先级调度，各流轮流发送
+        if (id == 0)
+            return fail(PROTOCOL_ERROR);
+        if (len != 5)
+            return reset_stream(id, FRAME_SIZE_ERROR);
+        return;
+    case FRAME_RST_STREAM:
+    {
+        if (id == 0 || id > m_last_stream)
+            return fail(PROTOCOL_ERROR);
+        if (len != 4)
+            return fail(FRAME_SIZE_ERROR);
+        auto it = m_streams.find(id);
+        if (it != m_streams.end())
+            release_stream(it);
+        return;
+    }
+    case FRAME_SETTINGS:
+        if (id != 0)
+            return fail(PROTOCOL_ERROR);
+        if (flags & FLAG_ACK)
+        {
+            if (len != 0)
+                fail(FRAME_SIZE_ERROR);
+            return;
+        }
+        if (len % 6 != 0)
+            return fail(FRAME_SIZE_ERROR);
+        if (!apply_settings(p, len))
+            return;
+        m_settings = true;
+        add_frame(m_control, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+        return;
+    case FRAME_PUSH_PROMISE:
+        return fail(PROTOCOL_ERROR);// 客户端不能推送
+    case FRAME_PING:
+        if (id != 0)
+            return fail(PROTOCOL_ERROR);
+        if (len != 8)
+            return fail(FRAME_SIZE_ERROR);
+        if (!(flags & FLAG_ACK))
+        {
+            add_frame(m_control, 8, FRAME_PING, FLAG_ACK, 0);
+            m_control.append((const char *)p, 8);
+        }
+        return;
+    case FRAME_GOAWAY:
+        if (id != 0)
+            return fail(PROTOCOL_ERROR);
+        m_peer_goaway = true;
+        return;
+    case FRAME_WINDOW_UPDATE:
+        if (len != 4)
+            return fail(FRAME_SIZE_ERROR);
+        return on_window_update(id, p);
+    case FRAME_CONTINUATION:
+        if (!m_block_stream)
+            return fail(PROTOCOL_ERROR);
+        m_block.append((const char *)p, len);
+        //超出上限的头部仍要解码以保持动态表同步，之后按431回复；压缩后的头部块超过两倍上限才断开连接
+        if ((long)m_block.size() > 2 * m_max_request)
+            return fail(ENHANCE_YOUR_CALM);
+        if (flags & FLAG_END_HEADERS)
+            end_headers();
+        return;
+    default:
+        return;// 未知类型的帧忽略
+    }
+}
+
+//流量控制按整个载荷（含填充）计算；接收窗口在处理后立即补回，请求体只受单个请求的上限约束
+void h2_session::on_data(uint8_t flags, uint32_t id, const unsigned char *p, uint32_t len)
+{
+    if (id == 0)
+        return fail(PROTOCOL_ERROR);
+    m_recv_window -= len;
+    if (m_recv_window < 0)
+        return fail(FLOW_CONTROL_ERROR);
+    if (len > 0)
+    {
+        add_window_update(0, len);
+        m_recv_window += len;
+    }
+    uint32_t full = len;
+    if (flags & FLAG_PADDED)
+    {
+        if (len == 0 || p[0] >= len)
+            return fail(PROTOCOL_ERROR);
+        len -= 1 + p[0];
+        ++p;
+    }
+    auto it = m_streams.find(id);
+    if (it == m_streams.end() || it->second.request_done)
+    {
+        if (id > m_last_stream)
+            return fail(PROTOCOL_ERROR);// 尚未打开的流
+        return reset_stream(id, STREAM_CLOSED);
+    }
+    h2_stream &s = it->second;
+    s.recv_window -= full;
+    if (s.recv_window < 0)
+        return reset_stream(id, FLOW_CONTROL_ERROR);
+    if (!s.too_large)
+    {
+        if ((long)(s.body.size() + len) > m_max_request)
+        {
+            s.too_large = true;
+            std::string().swap(s.body);
+        }
+        else
+            s.body.append((const char *)p, len);
+    }
+    if (flags & FLAG_END_STREAM)
+    {
+        s.request_done = true;
+        m_ready.push_back(id);
+    }
+    else if (full > 0)
+    {
+        add_window_update(id, full);
+        s.recv_window += full;
+    }
+}
+
+void h2_session::on_headers(uint8_t flags, uint32_t id, const unsigned char *p, uint32_t len)
+{
+    if (id == 0)
+        return fail(PROTOCOL_ERROR);
+    if (flags & FLAG_PADDED)
+    {
+        if (len == 0 || p[0] >= len)
+            return fail(PROTOCOL_ERROR);
+        len -= 1 + p[0];
+        ++p;
+    }
+    if (flags & FLAG_PRIORITY)
+    {
+        if (len < 5)
+            return fail(FRAME_SIZE_ERROR);
+        p += 5;
+        len -= 5;
+    }
+    m_block.assign((const char *)p, len);
+    m_block_stream = id;
+    m_block_end_stream = flags & FLAG_END_STREAM;
+    if (flags & FLAG_END_HEADERS)
+        end_headers();
+}
+
+//头部块无论是否接受该流都要解码，HPACK的动态表才能与客户端保持一致
+void h2_session::end_headers()
+{
+    uint32_t id = m_block_stream;
+    m_block_stream = 0;
+    std::vector<hpack_field> fields;
+    size_t list_size;
+    bool ok = m_decoder.decode((const unsigned char *)m_block.data(), m_block.size(), fields, list_size);
+    std::string().swap(m_block);
+    if (!ok)
+        return fail(COMPRESSION_ERROR);
+
+    auto it = m_streams.find(id);
+    if (it != m_streams.end())
+    {
+        //请求体之后的尾部头部，必须结束该流，内容忽略
+        if (it->second.request_done)
+            return reset_stream(id, STREAM_CLOSED);
+        if (!m_block_end_stream)
+            return fail(PROTOCOL_ERROR);
+        it->second.request_done = true;
+        m_ready.push_back(id);
+        return;
+    }
+    if (id % 2 == 0 || id <= m_last_stream)
+        return fail(PROTOCOL_ERROR);
+    if (m_streams.size() >= (size_t)MAX_STREAMS)
+    {
+        m_last_stream = id;
+        return reset_stream(id, REFUSED_STREAM);
+    }
+    h2_stream &s = open_stream(id);
+    s.fields.swap(fields);
+    s.list_size = list_size;
+    if (m_block_end_stream)
+    {
+        s.request_done = true;
+        m_ready.push_back(id);
+    }
+}
+
+bool h2_session::apply_settings(const unsigned char *p, uint32_t len)
+{
+    for (uint32_t i = 0; i + 6 <= len; i += 6)
+    {
+        int id = p[i] << 8 | p[i + 1];
+        uint32_t value = get32(p + i + 2);
+        switch (id)
+        {
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+            {
+                fail(PROTOCOL_ERROR);
+                return false;
+            }
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            //已打开的流按差值调整发送窗口，可以变为负数
+            if (value > MAX_WINDOW)
+            {
+                fail(FLOW_CONTROL_ERROR);
+                return false;
+            }
+            long delta = (long)value - m_peer_window;
+            for (auto &item : m_streams)
+            {
+                item.second.send_window += delta;
+                if (item.second.send_window > MAX_WINDOW)
+                {
+                    fail(FLOW_CONTROL_ERROR);
+                    return false;
+                }
+            }
+            m_peer_window = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < MAX_FRAME_SIZE || value > 0xffffff)
+            {
+                fail(PROTOCOL_ERROR);
+                return false;
+            }
+            m_peer_frame = value;
+            break;
+        default:
+            break;// 编码端不使用动态表，其余参数与服务器无关
+        }
+    }
+    return true;
+}
+
+void h2_session::on_window_update(uint32_t id, const unsigned char *p)
+{
+    long increment = get32(p) & 0x7fffffff;
+    if (id == 0)
+    {
+        if (increment == 0)
+            return fail(PROTOCOL_ERROR);
+        m_send_window += increment;
+        if (m_send_window > MAX_WINDOW)
+            fail(FLOW_CONTROL_ERROR);
+        return;
+    }
+    auto it = m_streams.find(id);
+    if (it == m_streams.end())
+    {
+        if (id > m_last_stream)
+            fail(PROTOCOL_ERROR);
+        return;// 已结束的流
+    }
+    if (increment == 0)
+        return reset_stream(id, PROTOCOL_ERROR);
+    it->second.send_window += increment;
+    if (it->second.send_window > MAX_WINDOW)
+        reset_stream(id, FLOW_CONTROL_ERROR);
+}
+
+h2_stream *h2_session::next_request()
+{
+    while (!m_ready.empty() && !m_failed)
+    {
+        auto it = m_streams.find(m_ready.front());
+        m_ready.pop_front();
+        if (it != m_streams.end() && !it->second.responded)
+            return &it->second;
+    }
+    return nullptr;
+}
+
+void h2_session::respond(h2_stream *s, std::string &head, file_entry *entry, const char *data, off_t offset, off_t len)
+{
+    s->responded = true;
+    s->head.swap(head);
+    s->entry = entry;
+    s->data = data;
+    s->offset = offset;
+    s->remaining = len;
+    std::vector<hpack_field>().swap(s->fields);
+    std::string().swap(s->body);
+}
+
+//输出缓冲中的段先记下偏移（base为空），整批排完、缓冲不再增长后再换成地址；相邻的帧头合并为一段
+int h2_session::pull(h2_segment *segs, int max_segs, int max_files)
+{
+    m_out.clear();
+    int n = 0, files = 0;
+    auto add_out = [&](size_t start) {
+        if (n > 0 && !segs[n - 1].base && !segs[n - 1].entry && segs[n - 1].offset + segs[n - 1].len == start)
+            segs[n - 1].len = m_out.size() - segs[n - 1].offset;
+        else
+            segs[n++] = {nullptr, m_out.size() - start, nullptr, (off_t)start};
+    };
+
+    if (!m_control.empty() && n < max_segs)
+    {
+        m_out.swap(m_control);
+        m_control.clear();
+        add_out(0);
+    }
+
+    //响应的HEADERS，头部块超出客户端的帧长度上限时拆出CONTINUATION
+    for (auto &item : m_streams)
+    {
+        h2_stream &s = item.second;
+        if (m_failed || n + 1 > max_segs)
+            break;
+        if (!s.responded || s.head_sent)
+            continue;
+        size_t start = m_out.size();
+        size_t sent = 0;
+        do
+        {
+            size_t len = s.head.size() - sent < m_peer_frame ? s.head.size() - sent : m_peer_frame;
+            bool last = sent + len == s.head.size();
+            uint8_t flags = (last ? FLAG_END_HEADERS : 0) | (sent == 0 && s.remaining == 0 ? FLAG_END_STREAM : 0);
+            add_frame(m_out, len, sent == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, s.id);
+            m_out.append(s.head, sent, len);
+            sent += len;
+        } while (sent < s.head.size());
+        add_out(start);
+        s.head_sent = true;
+        std::string().swap(s.head);
+    }
+
+    //DATA：每轮每个流最多一帧，从上次停下的流之后开始，连接窗口、本批的段数或文件数用完为止
+    bool progress = true, full = false;
+    while (progress && !full && !m_failed && m_send_window > 0)
+    {
+        progress = false;
+        auto start = m_streams.lower_bound(m_turn);
+        for (size_t i = 0; i < m_streams.size() && m_send_window > 0; ++i, ++start)
+        {
+            if (start == m_streams.end())
+                start = m_streams.begin();
+            h2_stream &s = start->second;
+            if (!s.head_sent || s.remaining == 0 || s.send_window <= 0)
+                continue;
+            if (n + 2 > max_segs || (s.entry && files + 1 > max_files))
+            {
+                full = true;
+                break;
+            }
+            off_t len = s.remaining;
+            if (len > s.send_window)
+                len = s.send_window;
+            if (len > m_send_window)
+                len = m_send_window;
+            if (len > (off_t)m_peer_frame)
+                len = m_peer_frame;
+            size_t head = m_out.size();
+            add_frame(m_out, len, FRAME_DATA, len == s.remaining ? FLAG_END_STREAM : 0, s.id);
+            add_out(head);
+            segs[n++] = {s.data ? s.data + s.offset : nullptr, (size_t)len, s.entry, s.offset};
+            if (s.entry)
+                ++files;
+            s.offset += len;
+            s.remaining -= len;
+            s.send_window -= len;
+            m_send_window -= len;
+            m_turn = s.id + 1;
+            progress = true;
+        }
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (!segs[i].base && !segs[i].entry)
+            segs[i].base = m_out.data() + segs[i].offset;
+    }
+
+    //响应已全部排入输出的流结束；本批引用的缓存项由连接另外持有
+    for (auto it = m_streams.begin(); it != m_streams.end();)
+    {
+        auto next = std::next(it);
+        if (it->second.head_sent && it->second.remaining == 0)
+            release_stream(it);
+        it = next;
+    }
+    return n;
+}
+
+bool h2_session::want_write() const
+{
+    if (!m_control.empty())
+        return true;
+    if (m_failed)
+        return false;
+    for (auto &item : m_streams)
+    {
+        const h2_stream &s = item.second;
+        if ((s.responded && !s.head_sent) || (s.remaining > 0 && s.send_window > 0 && m_send_window > 0))
+            return true;
+    }
+    return false;
+}
+
+bool h2_session::closed() const
+{
+    return m_failed || (m_peer_goaway && m_streams.empty());
+}
@@ -0,0 +1,131 @@
+#ifndef H2_SESSION_H
+#define H2_SESSION_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hpack.h"
+#include "../filecache/file_cache.h"
+
+//一批待发送数据中的一段：帧头、头部块与控制帧在会话的输出缓冲中，DATA的内容直接引用缓存项中的内存或由sendfile发送
+struct h2_segment
+{
+    const char *base;// 内存中的数据，sendfile发送的文件内容为空
+    size_t len;
+    file_entry *entry;// 内容来自缓存项时非空，连接在发送完之前另持有一个引用
+    off_t offset;// sendfile方式下的文件偏移
+};
+
+//一个流：请求的头部与请求体，以及生成响应后尚未发送的部分
+struct h2_stream
+{
+    uint32_t id;
+    std::vector<hpack_field> fields;// 请求的全部头部，含伪头部
+    size_t list_size;// 按RFC计算的头部列表大小
+    std::string body;// 请求体
+    bool request_done;// 客户端已发送END_STREAM
+    bool too_large;// 请求体超出上限，之后的内容丢弃，响应413
+    long send_window;// 该流的发送窗口
+    long recv_window;// 该流的接收窗口
+    bool responded;// 已生成响应
+    bool head_sent;// 响应的HEADERS已排入输出
+    std::string head;// 响应的头部块
+    file_entry *entry;// 响应体来自缓存项时持有的引用
+    const char *data;// 响应体在内存中的起始位置，sendfile方式为空
+    off_t offset;// 下一段响应体相对data（或文件开头）的偏移
+    off_t remaining;// 尚未发送的响应体长度
+};
+
+//HTTP/2（h2c，RFC 9113）的连接状态：解析客户端的帧，维护流、双向的流量控制窗口与HPACK解码器；
+//完整的请求交给http_conn按HTTP/1.1相同的路径处理，生成的响应按窗口切成DATA帧，各流轮流发送
+class h2_session
+{
+public:
+    enum ERROR_CODE
+    {
+        NO_ERROR = 0,
+        PROTOCOL_ERROR,
+        INTERNAL_ERROR,
+        FLOW_CONTROL_ERROR,
+        SETTINGS_TIMEOUT,
+        STREAM_CLOSED,
+        FRAME_SIZE_ERROR,
+        REFUSED_STREAM,
+        CANCEL,
+        COMPRESSION_ERROR,
+        CONNECT_ERROR,
+        ENHANCE_YOUR_CALM
+    };
+    static const int FRAME_HEADER = 9;
+    static const int MAX_FRAME_SIZE = 16384;// 接收与发送的帧长度上限，即SETTINGS_MAX_FRAME_SIZE的默认值
+    static const int MAX_STREAMS = 100;// 通告的SETTINGS_MAX_CONCURRENT_STREAMS
+    static const long WINDOW_SIZE = 65535;// 接收窗口的初始值，DATA处理后立即用WINDOW_UPDATE补回
+    static const int PREFACE_LEN = 24;
+    static const char PREFACE[];// 客户端连接前言"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+    explicit h2_session(long max_request);// max_request为单个请求的头部列表与请求体的上限
+    ~h2_session();
+
+    //h2c升级：settings是HTTP2-Settings的取值（base64url编码的SETTINGS载荷），升级请求本身成为流1，返回该流；取值不合法时返回空
+    h2_stream *upgrade(const char *settings);
+
+    long receive(const char *buf, long len);// 处理buf中完整的帧，返回消耗的字节数，不完整的帧留待下次
+    bool input_ready(const char *buf, long len) const;// buf中是否有完整的帧（或连接前言）可以处理
+    h2_stream *next_request();// 取出下一个已接收完整、尚未响应的请求
+
+    //为请求生成响应：head为头部块（交换进流中），响应体为data开始的len字节，data为空时按entry的fd从offset开始sendfile；
+    //entry的引用交给会话，响应发送完或流被重置时释放
+    void respond(h2_stream *s, std::string &head, file_entry *entry, const char *data, off_t offset, off_t len);
+
+    //把待发送的控制帧、HEADERS与DATA排成一批，最多max_segs段，其中来自缓存项的内容最多max_files段；返回段数。
+    //上一批发送完之后才能再调用，输出缓冲在调用时复用
+    int pull(h2_segment *segs, int max_segs, int max_files);
+    bool want_write() const;// 还有可以发送的帧：窗口用完的流要等WINDOW_UPDATE
+    bool closed() const;// 已发送GOAWAY，或客户端发来GOAWAY且流都已结束，发送完本批后关闭连接
+    void fail(ERROR_CODE code);// 连接错误：排入GOAWAY，不再处理之后的帧
+
+private:
+    void handle_frame(uint8_t type, uint8_t flags, uint32_t id, const unsigned char *p, uint32_t len);
+    void on_data(uint8_t flags, uint32_t id, const unsigned char *p, uint32_t len);
+    void on_headers(uint8_t flags, uint32_t id, const unsigned char *p, uint32_t len);
+    void end_headers();// 头部块接收完整（END_HEADERS），解码并建立流
+    bool apply_settings(const unsigned char *p, uint32_t len);
+    void on_window_update(uint32_t id, const unsigned char *p);
+    void reset_stream(uint32_t id, ERROR_CODE code);// 流错误：排入RST_STREAM并丢弃该流
+    void release_stream(std::map<uint32_t, h2_stream>::iterator it);
+    h2_stream &open_stream(uint32_t id);
+
+    void add_frame(std::string &out, uint32_t len, uint8_t type, uint8_t flags, uint32_t id);// 帧头
+    void add_window_update(uint32_t id, uint32_t increment);
+
+private:
+    long m_max_request;
+    hpack_decoder m_decoder;
+    std::map<uint32_t, h2_stream> m_streams;// 未结束的流，按编号有序，DATA从上次停下的编号之后轮流发送
+    std::deque<uint32_t> m_ready;// 已接收完整、等待处理的请求
+    uint32_t m_last_stream;// 已接受的最大流编号，GOAWAY中告知客户端
+    uint32_t m_turn;// 下一轮DATA从这个编号开始
+    bool m_preface;// 已收到连接前言
+    bool m_settings;// 已收到客户端的第一个SETTINGS
+    bool m_failed;// 已排入GOAWAY
+    bool m_peer_goaway;// 客户端已发送GOAWAY，不会再打开新的流
+
+    //HEADERS之后的CONTINUATION：头部块拼接完整后才能解码
+    std::string m_block;
+    uint32_t m_block_stream;// 0表示没有未完成的头部块
+    bool m_block_end_stream;
+
+    long m_send_window;// 连接的发送窗口
+    long m_recv_window;// 连接的接收窗口
+    long m_peer_window;// 客户端SETTINGS_INITIAL_WINDOW_SIZE，新流的发送窗口
+    uint32_t m_peer_frame;// 客户端SETTINGS_MAX_FRAME_SIZE
+
+    std::string m_control;// 处理帧时产生、尚未发送的控制帧：SETTINGS、ACK、WINDOW_UPDATE、RST_STREAM与GOAWAY
+    std::string m_out;// 当前一批的帧头与头部块
+};
+
+#endif
@@ -0,0 +1,413 @@
+#include <string.h>
+
+#include "hpack.h"
+
+//静态表（RFC 7541附录A），下标从1开始
+static const int STATIC_COUNT = 61;
+static const struct
+{
+    const char *name;
+    const char *value;
+} STATIC_TABLE[STATIC_COUNT] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+//Huffman编码表（RFC 7541附录B），第256项为EOS
+static const uint32_t HUFFMAN_CODES[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff,
+};
+static const unsigned char HUFFMAN_BITS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+//按编码表建立的解码树，逐位走到叶子得到一个符号；第一次使用时构造
+struct huffman_tree
+{
+    short child[2 * 257][2];// 内部节点的两个子节点，叶子为-1-符号
+    int count;
+
+    huffman_tree() : count(1)
+    {
+        memset(child, 0, sizeof(child));
+        for (int sym = 0; sym < 257; ++sym)
+        {
+            int node = 0;
+            for (int bit = HUFFMAN_BITS[sym] - 1; bit >= 0; --bit)
+            {
+                int b = (HUFFMAN_CODES[sym] >> bit) & 1;
+                if (bit == 0)
+                    child[node][b] = -1 - sym;
+                else
+                {
+                    if (child[node][b] == 0)
+                        child[node][b] = count++;
+                    node = child[node][b];
+                }
+            }
+        }
+    }
+};
+
+//末尾不足一个符号的填充必须是不超过7位的全1（EOS的前缀），EOS本身不能出现
+static bool huffman_decode(const unsigned char *p, size_t len, std::string &out)
+{
+    static const huffman_tree tree;
+    int node = 0;
+    int pad = 0;// 自上一个符号以来走过的位数
+    bool ones = true;// 这些位是否全为1
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (int bit = 7; bit >= 0; --bit)
+        {
+            int b = (p[i] >> bit) & 1;
+            int next = tree.child[node][b];
+            ++pad;
+            ones = ones && b;
+            if (next < 0)
+            {
+                if (next == -1 - 256)
+                    return false;
+                out += (char)(-1 - next);
+                node = 0;
+                pad = 0;
+                ones = true;
+            }
+            else if (next == 0)
+                return false;
+            else
+                node = next;
+        }
+    }
+    return pad <= 7 && ones;
+}
+
+//N位前缀的整数：前缀放得下时只占第一个字节，否则前缀全1，其后每字节7位，低位在前
+static bool decode_int(const unsigned char *&p, const unsigned char *end, int prefix, uint64_t &value)
+{
+    if (p == end)
+        return false;
+    uint64_t mask = (1u << prefix) - 1;
+    value = *p++ & mask;
+    if (value < mask)
+        return true;
+    for (int shift = 0; shift <= 56; shift += 7)
+    {
+        if (p == end)
+            return false;
+        unsigned char b = *p++;
+        value += (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void encode_int(std::string &out, unsigned char flags, int prefix, uint64_t value)
+{
+    uint64_t mask = (1u << prefix) - 1;
+    if (value < mask)
+    {
+        out += (char)(flags | value);
+        return;
+    }
+    out += (char)(flags | mask);
+    value -= mask;
+    while (value >= 0x80)
+    {
+        out += (char)(0x80 | (value & 0x7f));
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static bool decode_string(const unsigned char *&p, const unsigned char *end, std::string &out)
+{
+    if (p == end)
+        return false;
+    bool huffman = *p & 0x80;
+    uint64_t len;
+    if (!decode_int(p, end, 7, len) || len > (uint64_t)(end - p))
+        return false;
+    out.clear();
+    if (huffman)
+    {
+        if (!huffman_decode(p, len, out))
+            return false;
+    }
+    else
+        out.assign((const char *)p, len);
+    p += len;
+    return true;
+}
+
+//编码端不用Huffman，原样写入
+static void encode_string(std::string &out, const char *s, size_t len)
+{
+    encode_int(out, 0x00, 7, len);
+    out.append(s, len);
+}
+
+bool hpack_decoder::lookup(uint64_t index, hpack_field &field) const
+{
+    if (index == 0)
+        return false;
+    if (index <= (uint64_t)STATIC_COUNT)
+    {
+        field.name = STATIC_TABLE[index - 1].name;
+        field.value = STATIC_TABLE[index - 1].value;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if (index >= m_table.size())
+        return false;
+    field = m_table[index];
+    return true;
+}
+
+void hpack_decoder::evict(size_t limit)
+{
+    while (m_size > limit)
+    {
+        const hpack_field &oldest = m_table.back();
+        m_size -= oldest.name.size() + oldest.value.size() + 32;
+        m_table.pop_back();
+    }
+}
+
+//比上限还大的一项会清空动态表且不加入（RFC 7541 4.4）
+void hpack_decoder::insert(const hpack_field &field)
+{
+    size_t size = field.name.size() + field.value.size() + 32;
+    evict(size > m_max_size ? 0 : m_max_size - size);
+    if (size > m_max_size)
+        return;
+    m_table.push_front(field);
+    m_size += size;
+}
+
+bool hpack_decoder::decode(const unsigned char *block, size_t len, std::vector<hpack_field> &fields, size_t &list_size)
+{
+    const unsigned char *p = block, *end = block + len;
+    list_size = 0;
+    while (p < end)
+    {
+        unsigned char b = *p;
+        uint64_t index;
+        hpack_field field;
+        if (b & 0x80)
+        {
+            //完整引用表中的一项
+            if (!decode_int(p, end, 7, index) || !lookup(index, field))
+                return false;
+        }
+        else if ((b & 0xe0) == 0x20)
+        {
+            //动态表大小更新
+            if (!decode_int(p, end, 5, index) || index > TABLE_SIZE)
+                return false;
+            m_max_size = index;
+            evict(m_max_size);
+            continue;
+        }
+        else
+        {
+            //字面量：01为加入动态表，0000为不加入，0001为永不加入；名称可以引用表中的一项
+            bool indexing = b & 0x40;
+            if (!decode_int(p, end, indexing ? 6 : 4, index))
+                return false;
+            if (index)
+            {
+                if (!lookup(index, field))
+                    return false;
+            }
+            else if (!decode_string(p, end, field.name))
+                return false;
+            if (!decode_string(p, end, field.value))
+                return false;
+            if (indexing)
+                insert(field);
+        }
+        list_size += field.name.size() + field.value.size() + 32;
+        fields.push_back(std::move(field));
+    }
+    return true;
+}
+
+void hpack_encoder::add_status(std::string &out, int status)
+{
+    static const int indexed[] = {200, 204, 206, 304, 400, 404, 500};
+    for (int i = 0; i < 7; ++i)
+    {
+        if (indexed[i] == status)
+        {
+            encode_int(out, 0x80, 7, 8 + i);// :status 200是静态表第8项
+            return;
+        }
+    }
+    char digits[4] = {(char)('0' + status / 100 % 10), (char)('0' + status / 10 % 10), (char)('0' + status % 10), 0};
+    encode_int(out, 0x00, 4, 8);
+    encode_string(out, digits, 3);
+}
+
+void hpack_encoder::add_field(std::string &out, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    int index = 0;
+    for (int i = 0; i < STATIC_COUNT; ++i)
+    {
+        if (strlen(STATIC_TABLE[i].name) == name_len && memcmp(STATIC_TABLE[i].name, name, name_len) == 0)
+        {
+            index = i + 1;
+            break;
+        }
+    }
+    encode_int(out, 0x00, 4, index);
+    if (!index)
+        encode_string(out, name, name_len);
+    encode_string(out, value, value_len);
+}
+
+void hpack_encoder::add_http1(std::string &out, const char *text, size_t len)
+{
+    static const char *connection_fields[] = {"connection", "keep-alive", "transfer-encoding", "upgrade", "proxy-connection"};
+    const char *end = text + len;
+    while (text < end)
+    {
+        const char *eol = (const char *)memchr(text, '\n', end - text);
+        const char *line_end = eol ? eol : end;
+        const char *next = eol ? eol + 1 : end;
+        if (line_end > text && line_end[-1] == '\r')
+            --line_end;
+        const char *colon = (const char *)memchr(text, ':', line_end - text);
+        if (!colon || colon == text || strncmp(text, "HTTP/", 5) == 0)
+        {
+            text = next;
+            continue;
+        }
+        char name[64];
+        size_t name_len = colon - text;
+        if (name_len > sizeof(name))
+        {
+            text = next;
+            continue;
+        }
+        for (size_t i = 0; i < name_len; ++i)
+            name[i] = (text[i] >= 'A' && text[i] <= 'Z') ? text[i] + ('a' - 'A') : text[i];
+        bool skip = false;
+        for (const char *field : connection_fields)
+            skip = skip || (strlen(field) == name_len && memcmp(field, name, name_len) == 0);
+        const char *value = colon + 1;
+        while (value < line_end && (*value == ' ' || *value == '\t'))
+            ++value;
+        if (!skip)
+            add_field(out, name, name_len, value, line_end - value);
+        text = next;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+//HPACK（RFC 7541）头部压缩：解码客户端发来的头部块，维护它的动态表；
+//编码响应头部时只引用静态表，不使用动态表，因此编码端没有状态，各连接共用
+struct hpack_field
+{
+    std::string name;
+    std::string value;
+};
+
+class hpack_decoder
+{
+public:
+    static const size_t TABLE_SIZE = 4096;// 动态表的上限，与SETTINGS_HEADER_TABLE_SIZE的默认值相同，不另行通告
+
+    hpack_decoder() : m_size(0), m_max_size(TABLE_SIZE) {}
+
+    //解码一个完整的头部块，字段按顺序追加到fields，list_size为各字段按RFC计算的大小之和（名称 + 取值 + 32）；
+    //格式错误、索引越界或Huffman编码非法时返回false，按连接错误COMPRESSION_ERROR处理
+    bool decode(const unsigned char *block, size_t len, std::vector<hpack_field> &fields, size_t &list_size);
+
+private:
+    bool lookup(uint64_t index, hpack_field &field) const;// 1-61为静态表，之后为动态表，越新的下标越小
+    void insert(const hpack_field &field);// 加入动态表，超出上限时从最旧的一项开始淘汰
+    void evict(size_t limit);
+
+private:
+    std::deque<hpack_field> m_table;// 动态表，最新的在前
+    size_t m_size;// 动态表当前大小
+    size_t m_max_size;// 头部块中的大小更新设置的上限，不超过TABLE_SIZE
+};
+
+class hpack_encoder
+{
+public:
+    static void add_status(std::string &out, int status);// :status，静态表中有的状态码只用一个字节
+    static void add_field(std::string &out, const char *name, size_t name_len, const char *value, size_t value_len);// 不加入动态表的字面量，名称在静态表中时引用下标
+
+    //把HTTP/1.1格式的头部（"Name:value\r\n"，可带状态行）逐行转为字段，名称转小写，去掉HTTP/2中不允许的连接相关头部；
+    //缓存项中预先序列化的响应头与Date行因此可以直接复用
+    static void add_http1(std::string &out, const char *text, size_t len);
+};
+
+#endif
@@ -6,6 +6,10 @@
 #include <condition_variable>
 #include <atomic>
 #include <chrono>
+#include <list>
+#include <utility>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 // 使用条件变量实现的计数信号量，避免依赖POSIX信号量
 class sem
@@ -122,4 +126,46 @@ private:
     std::condition_variable m_cv;//条件变量，用于等待和通知
     bool m_notified{false};//是否通知，防止虚假唤醒
 };
+//完成队列：工作线程把处理完的 (fd, 事件) 投递给所属事件循环，并通过eventfd唤醒它，
+//事件循环把notifyfd注册到自己的epoll/io_uring中，被唤醒后一次取出全部投递
+struct completion
+{
+    int fd;
+    int ev;// 要重新注册的事件，0表示不注册
+    int state;// 连接所处的超时阶段，-1表示关闭连接
+    unsigned generation;// 连接交给工作线程时的代数，与连接当前的代数不同说明连接已关闭，fd可能已被新连接复用
+};
+
+class completion_queue
+{
+public:
+    completion_queue() : m_notifyfd(eventfd(0, EFD_NONBLOCK)) {}
+    ~completion_queue()
+    {
+        if (m_notifyfd != -1)
+            close(m_notifyfd);
+    }
+    void post(int fd, int ev, int state = 0, unsigned generation = 0)//投递一个完成事件（工作线程调用）
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_items.push_back(completion{fd, ev, state, generation});
+        }
+        eventfd_write(m_notifyfd, 1);
+    }
+    bool take(std::list<completion> &items)//取出全部完成事件（事件循环调用）
+    {
+        eventfd_t count;
+        eventfd_read(m_notifyfd, &count);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        items.swap(m_items);
+        return !items.empty();
+    }
+    int notifyfd() const { return m_notifyfd; }
+
+private:
+    int m_notifyfd;//eventfd，投递后唤醒事件循环
+    std::mutex m_mutex;//保护完成事件列表
+    std::list<completion> m_items;//已完成的事件
+};
 #endif
@@ -16,7 +16,8 @@ int main(int argc, char *argv[])
     //初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite, 
                 config.OPT_LINGER, config.TRIGMode,  config.sql_num,  config.thread_num, 
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.reactor_num, config.io_backend, config.max_request, config.zero_copy, config.precompress,
+                config.compress_level, config.compress_budget, config.cache_rules, config.http2);
     
 
     //日志
@@ -0,0 +1,47 @@
+#include "buffer_pool.h"
+
+buffer_pool::buffer_pool(size_t block_size, int batch)
+{
+    //块中要能放下空闲链表的指针，并按指针大小对齐
+    m_block_size = (block_size + sizeof(char *) - 1) / sizeof(char *) * sizeof(char *);
+    m_batch = batch;
+    m_free = nullptr;
+    m_allocated = 0;
+    m_in_use = 0;
+}
+
+void buffer_pool::grow()
+{
+    char *chunk = new char[m_block_size * m_batch];
+    m_chunks.emplace_back(chunk);
+    for (int i = 0; i < m_batch; ++i)
+    {
+        char *block = chunk + i * m_block_size;
+        *(char **)block = m_free;
+        m_free = block;
+    }
+    m_allocated += m_batch;
+}
+
+char *buffer_pool::acquire()
+{
+    m_lock.lock();
+    if (!m_free)
+        grow();
+    char *block = m_free;
+    m_free = *(char **)block;
+    ++m_in_use;
+    m_lock.unlock();
+    return block;
+}
+
+void buffer_pool::release(char *block)
+{
+    if (!block)
+        return;
+    m_lock.lock();
+    *(char **)block = m_free;
+    m_free = block;
+    --m_in_use;
+    m_lock.unlock();
+}
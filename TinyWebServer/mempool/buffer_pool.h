@@ -0,0 +1,37 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <vector>
+#include <memory>
+#include "../lock/locker.h"
+
+//定长缓冲块池：连接只在请求处理期间借用缓冲块，空闲时归还，空闲的长连接不占用读写缓冲。
+//空闲块通过块首部的指针串成单链表，不足时按批从堆上分配，分配出的内存直到池析构才释放。
+class buffer_pool
+{
+public:
+    explicit buffer_pool(size_t block_size, int batch = 64);
+    ~buffer_pool() {}
+
+    char *acquire();// 借出一个缓冲块（内容未初始化）
+    void release(char *block);// 归还缓冲块
+
+    size_t block_size() const { return m_block_size; }
+    int allocated() const { return m_allocated; }// 已从堆上分配的块数
+    int in_use() const { return m_in_use; }// 正在被借用的块数
+
+private:
+    void grow();// 按批分配新块并挂到空闲链表
+
+private:
+    size_t m_block_size;// 块大小
+    int m_batch;// 每次扩容分配的块数
+    char *m_free;// 空闲链表头
+    int m_allocated;
+    int m_in_use;
+    std::vector<std::unique_ptr<char[]>> m_chunks;// 按批分配的内存
+    locker m_lock;// 多个事件循环和工作线程都会借还缓冲块
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SLAB_TABLE_H
+#define SLAB_TABLE_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+
+//按下标（fd）索引的对象表：某个下标第一次被使用时才从slab中分配对象，一次分配一整块slab，
+//避免启动时就为全部MAX_FD个连接构造对象。对象分配后一直挂在该下标上，fd关闭后留给复用该fd的新连接，
+//因此迟到的完成通知、定时器回调仍然可以安全访问；对象在表析构时随slab一起释放。
+//分配时加锁（多个子反应堆可能同时接收新连接）；下标项是原子指针，分配时release写入、访问时acquire读取，
+//其他线程看到指针时对象已构造完成，已分配下标的访问不加锁。
+template <typename T>
+class slab_table
+{
+public:
+    explicit slab_table(int max_index, int slab_size = 256)
+        : m_index(new std::atomic<T *>[max_index]()), m_max_index(max_index), m_slab_size(slab_size), m_used(slab_size) {}
+
+    T &operator[](int index)//返回下标对应的对象，不存在时先分配
+    {
+        T *obj = m_index[index].load(std::memory_order_acquire);
+        return obj ? *obj : *allocate(index);
+    }
+    T *peek(int index) const { return m_index[index].load(std::memory_order_acquire); }// 只查询，不分配
+    int capacity() const { return m_max_index; }
+
+private:
+    T *allocate(int index)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        T *obj = m_index[index].load(std::memory_order_relaxed);
+        if (!obj)
+        {
+            if (m_used == m_slab_size)
+            {
+                m_slabs.emplace_back(new T[m_slab_size]);
+                m_used = 0;
+            }
+            obj = &m_slabs.back()[m_used++];
+            m_index[index].store(obj, std::memory_order_release);
+        }
+        return obj;
+    }
+
+private:
+    std::unique_ptr<std::atomic<T *>[]> m_index;// 下标到对象的映射
+    std::vector<std::unique_ptr<T[]>> m_slabs;// 已分配的slab
+    int m_max_index;// 下标上限
+    int m_slab_size;// 每块slab中的对象数
+    int m_used;// 最后一块slab已使用的对象数
+    std::mutex m_mutex;// 保护slab分配
+};
+
+#endif
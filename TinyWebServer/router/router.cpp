@@ -0,0 +1,234 @@
+#include <string.h>
+#include "router.h"
+
+const char route_handler::PENDING[] = "";
+
+int router::new_node(const char *label, size_t len)
+{
+    build_node b;
+    b.label.assign(label, len);
+    b.param = -1;
+    for (int i = 0; i < ROUTE_METHOD_COUNT; ++i)
+    {
+        b.exact[i] = nullptr;
+        b.prefix[i] = nullptr;
+    }
+    m_build.push_back(b);
+    return m_build.size() - 1;
+}
+
+//子节点的标签首字节各不相同：没有同首字节的子节点时新建一条边，
+//与已有的边只有部分公共前缀时在公共前缀处拆开，新的中间节点接替原来的位置
+int router::static_child(int n, const char *text, size_t len)
+{
+    while (len > 0)
+    {
+        int c = -1;
+        for (int k : m_build[n].children)
+        {
+            if (m_build[k].label[0] == text[0])
+            {
+                c = k;
+                break;
+            }
+        }
+        if (c < 0)
+        {
+            c = new_node(text, len);
+            m_build[n].children.push_back(c);
+            return c;
+        }
+        const std::string &label = m_build[c].label;
+        size_t k = 1;
+        while (k < label.size() && k < len && label[k] == text[k])
+            ++k;
+        if (k < label.size())
+        {
+            int mid = new_node(text, k);
+            m_build[c].label.erase(0, k);
+            m_build[mid].children.push_back(c);
+            for (int &child : m_build[n].children)
+            {
+                if (child == c)
+                    child = mid;
+            }
+            c = mid;
+        }
+        n = c;
+        text += k;
+        len -= k;
+    }
+    return n;
+}
+
+bool router::add(int method, const char *pattern, route_handler *handler)
+{
+    if (method < 0 || method >= ROUTE_METHOD_COUNT || !handler || !pattern || pattern[0] != '/')
+        return false;
+    if (m_build.empty())
+        new_node("", 0);
+    size_t len = strlen(pattern);
+    bool prefix = pattern[len - 1] == '*';
+    if (prefix)
+        --len;
+
+    int n = 0, params = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        //参数只能占据'/'之后的整段
+        if (pattern[i] == ':' && pattern[i - 1] == '/')
+        {
+            size_t j = i + 1;
+            while (j < len && pattern[j] != '/')
+                ++j;
+            if (j == i + 1 || ++params > route_request::MAX_PARAMS)
+                return false;
+            std::string name(pattern + i + 1, j - i - 1);
+            if (m_build[n].param < 0)
+            {
+                int c = new_node("", 0);
+                m_build[c].param_name = name;
+                m_build[n].param = c;
+            }
+            else if (m_build[m_build[n].param].param_name != name)
+                return false;// 同一位置的参数段只能有一个名称
+            n = m_build[n].param;
+            i = j;
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < len && !(pattern[j] == ':' && pattern[j - 1] == '/'))
+            ++j;
+        n = static_child(n, pattern + i, j - i);
+        i = j;
+    }
+    if (prefix)
+        m_build[n].prefix[method] = handler;
+    else
+        m_build[n].exact[method] = handler;
+    return true;
+}
+
+//按层重新编号：一个节点的静态子节点连续存放，参数子节点紧跟其后
+void router::compile()
+{
+    m_nodes.clear();
+    m_first.clear();
+    m_labels.clear();
+    m_handlers.clear();
+    if (m_build.empty())
+        new_node("", 0);
+
+    std::vector<int> order(1, 0);
+    for (size_t q = 0; q < order.size(); ++q)
+    {
+        const build_node &b = m_build[order[q]];
+        node nd;
+        nd.label = m_labels.size();
+        nd.label_len = b.label.size();
+        m_labels += b.label;
+        nd.name = m_labels.size();
+        nd.name_len = b.param_name.size();
+        m_labels += b.param_name;
+        nd.first_child = order.size();
+        nd.child_count = b.children.size();
+        order.insert(order.end(), b.children.begin(), b.children.end());
+        nd.param = -1;
+        if (b.param >= 0)
+        {
+            nd.param = order.size();
+            order.push_back(b.param);
+        }
+        for (int i = 0; i < ROUTE_METHOD_COUNT; ++i)
+        {
+            nd.exact[i] = 0;
+            nd.prefix[i] = 0;
+            route_handler *handlers[2] = {b.exact[i], b.prefix[i]};
+            uint16_t *slots[2] = {&nd.exact[i], &nd.prefix[i]};
+            for (int k = 0; k < 2; ++k)
+            {
+                if (!handlers[k])
+                    continue;
+                size_t h = 0;
+                while (h < m_handlers.size() && m_handlers[h] != handlers[k])
+                    ++h;
+                if (h == m_handlers.size())
+                    m_handlers.push_back(handlers[k]);
+                *slots[k] = h + 1;
+            }
+        }
+        m_nodes.push_back(nd);
+        m_first.push_back(b.label.empty() ? 0 : (unsigned char)b.label[0]);
+    }
+}
+
+//n的标签已经匹配，p为路径中剩余的部分；返回精确匹配的处理器下标，途经的前缀路由记入best
+int router::walk(int n, const char *p, const char *end, route_request &req, prefix_match &best) const
+{
+    const node &nd = m_nodes[n];
+    if (nd.prefix[req.method] && p - req.path > best.depth)
+    {
+        best.depth = p - req.path;
+        best.handler = nd.prefix[req.method];
+        best.param_count = req.param_count;
+        memcpy(best.params, req.params, req.param_count * sizeof(route_param));
+    }
+    if (p == end)
+        return nd.exact[req.method];
+
+    for (uint32_t i = nd.first_child, e = nd.first_child + nd.child_count; i < e; ++i)
+    {
+        if (m_first[i] != (unsigned char)*p)
+            continue;
+        const node &c = m_nodes[i];
+        if ((size_t)(end - p) >= c.label_len && memcmp(p, m_labels.data() + c.label, c.label_len) == 0)
+        {
+            int h = walk(i, p + c.label_len, end, req, best);
+            if (h)
+                return h;
+        }
+        break;
+    }
+
+    if (nd.param >= 0 && req.param_count < route_request::MAX_PARAMS)
+    {
+        const char *q = (const char *)memchr(p, '/', end - p);
+        if (!q)
+            q = end;
+        if (q > p)
+        {
+            const node &c = m_nodes[nd.param];
+            route_param &param = req.params[req.param_count++];
+            param.name = m_labels.data() + c.name;
+            param.name_len = c.name_len;
+            param.value = p;
+            param.len = q - p;
+            int h = walk(nd.param, q, end, req, best);
+            if (h)
+                return h;
+            --req.param_count;
+        }
+    }
+    return 0;
+}
+
+route_handler *router::match(route_request &req) const
+{
+    req.param_count = 0;
+    if (m_nodes.empty() || req.method < 0 || req.method >= ROUTE_METHOD_COUNT)
+        return nullptr;
+    prefix_match best;
+    best.depth = -1;
+    best.handler = 0;
+    int h = walk(0, req.path, req.path + req.path_len, req, best);
+    if (!h)
+    {
+        if (!best.handler)
+            return nullptr;
+        h = best.handler;
+        req.param_count = best.param_count;
+        memcpy(req.params, best.params, best.param_count * sizeof(route_param));
+    }
+    return m_handlers[h - 1];
+}
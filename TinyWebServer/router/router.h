@@ -0,0 +1,135 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum ROUTE_METHOD
+{
+    ROUTE_GET = 0,
+    ROUTE_POST,
+    ROUTE_METHOD_COUNT
+};
+
+//模式中":name"段匹配到的路径片段，不以'\0'结尾
+struct route_param
+{
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t len;
+};
+
+//请求所属的连接：处理器的结果要等其他线程（如数据库查询）给出时，由那个线程经resume交回；
+//generation为提交时连接的代数，连接已关闭或被新连接复用时结果被丢弃
+class route_waiter
+{
+public:
+    virtual ~route_waiter() {}
+    virtual void resume(unsigned generation, const char *target) = 0;
+};
+
+//处理器留下的后续工作：连接挂起请求之后才调用start，完成时调用waiter的resume，之后自行释放
+class route_job
+{
+public:
+    virtual ~route_job() {}
+    virtual void start() = 0;
+};
+
+//交给处理器的请求：路径以'\0'结尾，POST的请求体以'\0'结尾，GET时为空
+struct route_request
+{
+    static const int MAX_PARAMS = 4;
+
+    int method;
+    const char *path;
+    size_t path_len;
+    const char *body;
+    route_param params[MAX_PARAMS];
+    int param_count;
+    route_waiter *waiter;
+    unsigned generation;
+    route_job *job;// 处理器返回PENDING时留下的后续工作
+};
+
+//路由处理器：返回要发送的静态文件（网站根目录下的URL路径），返回空表示没有这个资源；
+//需要等待数据库等慢操作时把后续工作放入req.job并返回PENDING，工作线程不等待结果
+class route_handler
+{
+public:
+    static const char PENDING[];
+
+    virtual ~route_handler() {}
+    virtual const char *handle(route_request &req) = 0;
+};
+
+//路由表：启动时注册路由，compile之后编译成紧凑的前缀树，请求处理时只读，各线程并发查找不加锁。
+//模式有三种：精确路径"/log"，以'*'结尾的前缀"/static/*"，以及整段匹配的参数"/user/:id"；
+//同一路径静态段优先于参数段，都不匹配时取最长的前缀路由，每种方法各自注册处理器
+class router
+{
+public:
+    static router *get_instance()//获取路由表的单例实例
+    {
+        static router instance;
+        return &instance;
+    }
+
+    //注册一条路由，须在compile之前调用；模式不以'/'开头、参数段过多或同名冲突时返回false
+    bool add(int method, const char *pattern, route_handler *handler);
+    void compile();
+
+    //按方法与路径查找处理器，参数段写入req.params；没有匹配的路由时返回空
+    route_handler *match(route_request &req) const;
+
+private:
+    router() {}
+
+    //注册时的节点：边上的标签，以及静态子节点（首字节各不相同）和最多一个参数子节点
+    struct build_node
+    {
+        std::string label;
+        std::vector<int> children;
+        int param;
+        std::string param_name;
+        route_handler *exact[ROUTE_METHOD_COUNT];
+        route_handler *prefix[ROUTE_METHOD_COUNT];
+    };
+    //编译后的节点：子节点按层连续存放，标签与参数名集中在m_labels中，处理器用m_handlers的下标（加1，0表示没有）
+    struct node
+    {
+        uint32_t label;
+        uint32_t first_child;
+        int32_t param;// 参数子节点，-1表示没有
+        uint32_t name;// 参数节点的名称
+        uint16_t label_len;
+        uint16_t name_len;
+        uint16_t child_count;
+        uint16_t exact[ROUTE_METHOD_COUNT];
+        uint16_t prefix[ROUTE_METHOD_COUNT];
+    };
+    //已匹配的最长前缀路由与当时的参数
+    struct prefix_match
+    {
+        long depth;// 前缀的长度
+        uint16_t handler;
+        int param_count;
+        route_param params[route_request::MAX_PARAMS];
+    };
+
+    int new_node(const char *label, size_t len);
+    int static_child(int n, const char *text, size_t len);// 沿静态边插入text，必要时拆分已有的边，返回终点
+    int walk(int n, const char *p, const char *end, route_request &req, prefix_match &best) const;
+
+private:
+    std::vector<build_node> m_build;
+    std::vector<node> m_nodes;
+    std::vector<unsigned char> m_first;// 各节点标签的首字节，与m_nodes下标相同，查找子节点时只扫描连续的字节
+    std::string m_labels;
+    std::vector<route_handler *> m_handlers;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "http_scanner.h"
+
+static long find_bytes(const char *buf, long len, char a, char b)
+{
+    for (long i = 0; i < len; ++i)
+    {
+        if (buf[i] == a || buf[i] == b)
+            return i;
+    }
+    return len;
+}
+
+//没有SIMD时一次比较8字节（SWAR）：与a、b异或后为0的字节即匹配，最低的0字节位置是准确的
+static long find_scalar(const char *buf, long len, char a, char b)
+{
+    const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+    const uint64_t va = ones * (unsigned char)a, vb = ones * (unsigned char)b;
+    long i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, buf + i, 8);
+        uint64_t xa = word ^ va, xb = word ^ vb;
+        uint64_t mask = ((xa - ones) & ~xa & highs) | ((xb - ones) & ~xb & highs);
+        if (mask)
+            return i + __builtin_ctzll(mask) / 8;
+    }
+    return i + find_bytes(buf + i, len - i, a, b);
+}
+
+//PCMPESTRI在16字节中找集合{a, b}中任一字节第一次出现的位置，没有时返回16；不足16字节的尾部逐字节比较，不越过len读取
+__attribute__((target("sse4.2"))) static long find_sse42(const char *buf, long len, char a, char b)
+{
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    long i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+        int index = _mm_cmpestri(set, 2, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16)
+            return i + index;
+    }
+    return i + find_bytes(buf + i, len - i, a, b);
+}
+
+//每32字节与a、b各比较一次，合并后取最低的置位；剩下的16字节用SSE2，再剩下的逐字节比较
+__attribute__((target("avx2,bmi"))) static long find_avx2(const char *buf, long len, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    long i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(buf + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)));
+        if (mask)
+            return i + _tzcnt_u32(mask);
+    }
+    if (i + 16 <= len)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(va)),
+                                                       _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(vb))));
+        if (mask)
+            return i + _tzcnt_u32(mask);
+        i += 16;
+    }
+    return i + find_bytes(buf + i, len - i, a, b);
+}
+
+static long (*const IMPL_FIND[http_scanner::IMPL_COUNT])(const char *, long, char, char) = {find_scalar, find_sse42, find_avx2};
+
+http_scanner::IMPL http_scanner::m_impl = http_scanner::detect();
+long (*http_scanner::m_find)(const char *buf, long len, char a, char b) = IMPL_FIND[http_scanner::m_impl];
+
+http_scanner::IMPL http_scanner::detect()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi"))
+        return AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SSE42;
+    return SCALAR;
+}
+
+bool http_scanner::use(IMPL impl)
+{
+    if (impl < SCALAR || impl > detect())
+        return false;
+    m_impl = impl;
+    m_find = IMPL_FIND[impl];
+    return true;
+}
+
+const char *http_scanner::name(IMPL impl)
+{
+    static const char *names[IMPL_COUNT] = {"scalar", "sse4.2", "avx2"};
+    return names[impl];
+}
+
+long http_scanner::skip_blank(const char *buf, long len)
+{
+    long i = 0;
+    while (i < len && (buf[i] == ' ' || buf[i] == '\t'))
+        ++i;
+    return i;
+}
+
+bool http_scanner::split_request_line(const char *line, long len, http_token tokens[3])
+{
+    long method = find_blank(line, len);
+    if (method == len)
+        return false;
+    long url = method + skip_blank(line + method, len - method);
+    long url_len = find_blank(line + url, len - url);
+    if (url + url_len == len)
+        return false;
+    long version = url + url_len + skip_blank(line + url + url_len, len - url - url_len);
+    tokens[0] = {0, method};
+    tokens[1] = {url, url_len};
+    tokens[2] = {version, len - version};
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+//请求行与头部的向量化扫描：一次比较16（SSE4.2）或32（AVX2）字节，找出行结束与记号分隔符的位置，
+//只返回偏移，不修改缓冲区。启动时按CPU支持选择AVX2、SSE4.2或逐字节的实现，编译时不需要-mavx2
+struct http_token
+{
+    long offset;// 记号在行中的起始偏移
+    long len;// 记号长度
+};
+
+class http_scanner
+{
+public:
+    enum IMPL
+    {
+        SCALAR = 0,// 不用SIMD，一次比较8字节（SWAR）
+        SSE42,// PCMPESTRI一次比较16字节
+        AVX2,// 一次比较32字节
+        IMPL_COUNT
+    };
+
+    static bool use(IMPL impl);// 切换实现（基准测试对比用），CPU不支持时返回false
+    static IMPL current() { return m_impl; }
+    static const char *name(IMPL impl);
+
+    //在buf[0, len)中找第一个等于a或b的字节，返回其偏移，没有时返回len
+    static long find_any(const char *buf, long len, char a, char b) { return m_find(buf, len, a, b); }
+    static long find_eol(const char *buf, long len) { return m_find(buf, len, '\r', '\n'); }// 行结束：'\r'或'\n'
+    static long find_blank(const char *buf, long len) { return m_find(buf, len, ' ', '\t'); }// 记号之间的空格或制表符
+    static long skip_blank(const char *buf, long len);// 跳过开头的空白，空白通常只有一两个字节，逐字节比较
+
+    //把不含CRLF的请求行切分为方法、URL与版本，版本取URL之后的空白到行末的全部内容；缺少记号时返回false
+    static bool split_request_line(const char *line, long len, http_token tokens[3]);
+
+private:
+    static IMPL detect();// 当前CPU支持的最快实现
+
+private:
+    static IMPL m_impl;
+    static long (*m_find)(const char *buf, long len, char a, char b);
+};
+
+#endif
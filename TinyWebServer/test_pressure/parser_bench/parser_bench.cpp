@@ -0,0 +1,295 @@
+//请求解析基准测试：在典型浏览器请求上比较原来逐字节的行解析（parse_line写'\0' + strpbrk/strspn/strcasecmp）
+//与向量化扫描（http_scanner的标量、SSE4.2、AVX2实现）切分请求行、按完美哈希建立头部表的开销。
+//用法：./parser_bench [每种请求的解析次数]，默认 1000000
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../../scanner/http_scanner.h"
+#include "../../http/http_headers.h"
+
+//典型浏览器请求：页面导航、带Cookie的样式表、图片、带条件头的脚本
+static const char *REQUESTS[] = {
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "\r\n",
+
+    "GET /static/css/main.css HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; session=4f8a1c2e9b7d6e5f4a3b2c1d0e9f8a7b; theme=dark; _ga_ABCDEF1234=GS1.1.1700000000.3.1.1700000100.0.0.0\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n",
+
+    "GET /images/frame.jpg HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Accept: image/webp,image/avif,image/jxl,image/heic,image/heic-sequence,video/*;q=0.8,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.4 Safari/605.1.15\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+
+    "GET /static/js/app.js HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua-platform: \"Android\"\r\n"
+    "User-Agent: Mozilla/5.0 (Linux; Android 10; K) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Mobile Safari/537.36\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?1\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9\r\n"
+    "If-None-Match: \"ce8041-24a-18df6c9e7ea575c0\"\r\n"
+    "If-Modified-Since: Sat, 17 Oct 2026 20:56:44 GMT\r\n"
+    "\r\n",
+};
+
+//两种解析器共同的结果，用于核对解析一致
+struct parsed
+{
+    const char *url;
+    const char *host;
+    bool linger;
+    int headers;
+};
+
+//原实现：逐字节找CRLF并就地写'\0'，请求行用strpbrk/strspn/strcasecmp切分，头部逐个strncasecmp
+static bool legacy_parse(char *buf, long len, parsed &out)
+{
+    long checked = 0, start = 0;
+    bool request_line = true;
+    out = parsed{nullptr, nullptr, false, 0};
+    while (true)
+    {
+        bool ok = false;
+        for (; checked < len; ++checked)
+        {
+            char temp = buf[checked];
+            if (temp == '\r')
+            {
+                if (checked + 1 == len || buf[checked + 1] != '\n')
+                    return false;
+                buf[checked++] = '\0';
+                buf[checked++] = '\0';
+                ok = true;
+                break;
+            }
+            else if (temp == '\n')
+                return false;
+        }
+        if (!ok)
+            return false;
+        char *text = buf + start;
+        start = checked;
+        if (request_line)
+        {
+            char *url = strpbrk(text, " \t");
+            if (!url)
+                return false;
+            *url++ = '\0';
+            if (strcasecmp(text, "GET") != 0 && strcasecmp(text, "POST") != 0)
+                return false;
+            url += strspn(url, " \t");
+            char *version = strpbrk(url, " \t");
+            if (!version)
+                return false;
+            *version++ = '\0';
+            version += strspn(version, " \t");
+            if (strcasecmp(version, "HTTP/1.1") != 0)
+                return false;
+            out.url = url;
+            request_line = false;
+            continue;
+        }
+        if (text[0] == '\0')
+            return true;
+        ++out.headers;
+        if (strncasecmp(text, "Connection:", 11) == 0)
+        {
+            text += 11;
+            text += strspn(text, " \t");
+            out.linger = strcasecmp(text, "keep-alive") == 0;
+        }
+        else if (strncasecmp(text, "Host:", 5) == 0)
+        {
+            text += 5;
+            out.host = text + strspn(text, " \t");
+        }
+    }
+}
+
+//向量化扫描：行结束与请求行的记号由http_scanner给出偏移，头部按完美哈希识别名称后记入头部表，
+//头部结束时才从表中取出Connection与Host，与http_conn的解析方式相同
+static bool scanner_parse(char *buf, long len, parsed &out)
+{
+    http_header headers[32];
+    signed char index[HEADER_COUNT];
+    int count = 0;
+    long start = 0;
+    bool request_line = true;
+    memset(index, -1, sizeof(index));
+    out = parsed{nullptr, nullptr, false, 0};
+    while (true)
+    {
+        long end = start + http_scanner::find_eol(buf + start, len - start);
+        if (end + 1 >= len || buf[end] != '\r' || buf[end + 1] != '\n')
+            return false;
+        char *text = buf + start;
+        long line_len = end - start;
+        start = end + 2;
+        if (request_line)
+        {
+            http_token tokens[3];
+            if (!http_scanner::split_request_line(text, line_len, tokens))
+                return false;
+            if (!(tokens[0].len == 3 && strncasecmp(text, "GET", 3) == 0) && !(tokens[0].len == 4 && strncasecmp(text, "POST", 4) == 0))
+                return false;
+            if (tokens[2].len != 8 || strncasecmp(text + tokens[2].offset, "HTTP/1.1", 8) != 0)
+                return false;
+            out.url = text + tokens[1].offset;
+            text[tokens[1].offset + tokens[1].len] = '\0';
+            request_line = false;
+            continue;
+        }
+        if (line_len == 0)
+            break;
+        long colon = http_scanner::find_any(text, line_len, ':', ':');
+        if (colon == line_len || count == 32)
+            return false;
+        http_header &h = headers[count];
+        long value = colon + 1 + http_scanner::skip_blank(text + colon + 1, line_len - colon - 1);
+        long value_end = line_len;
+        while (value_end > value && (text[value_end - 1] == ' ' || text[value_end - 1] == '\t'))
+            --value_end;
+        h.name = text;
+        h.name_len = colon;
+        h.value = text + value;
+        h.value_len = value_end - value;
+        h.id = header_id_of(text, colon);
+        if (h.id != HEADER_UNKNOWN)
+            index[h.id] = count;
+        ++count;
+    }
+    out.headers = count;
+    if (index[HEADER_CONNECTION] >= 0)
+    {
+        http_header &h = headers[index[HEADER_CONNECTION]];
+        h.value[h.value_len] = '\0';
+        out.linger = strcasecmp(h.value, "keep-alive") == 0;
+    }
+    if (index[HEADER_HOST] >= 0)
+    {
+        http_header &h = headers[index[HEADER_HOST]];
+        h.value[h.value_len] = '\0';
+        out.host = h.value;
+    }
+    return true;
+}
+
+typedef bool (*parse_fn)(char *buf, long len, parsed &out);
+
+//每次解析前从原始请求复制一份（两种方式都会写缓冲区），复制的开销两边相同
+static double run(parse_fn parse, const std::vector<std::string> &requests, long rounds, long &bytes)
+{
+    char buf[4096];
+    parsed out;
+    long checksum = 0;
+    bytes = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (long r = 0; r < rounds; ++r)
+    {
+        for (const std::string &req : requests)
+        {
+            memcpy(buf, req.data(), req.size());
+            if (parse(buf, req.size(), out))
+                checksum += out.headers + out.linger;
+            bytes += req.size();
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    if (checksum == 0)
+        printf("parse failed\n");
+    return ns / (rounds * requests.size());
+}
+
+int main(int argc, char *argv[])
+{
+    long rounds = argc > 1 ? atol(argv[1]) : 1000000;
+    std::vector<std::string> requests(std::begin(REQUESTS), std::end(REQUESTS));
+
+    //先核对两种解析器在每种实现下得到相同的结果
+    for (int impl = http_scanner::SCALAR; impl < http_scanner::IMPL_COUNT; ++impl)
+    {
+        if (!http_scanner::use((http_scanner::IMPL)impl))
+            continue;
+        for (const std::string &req : requests)
+        {
+            char a[4096], b[4096];
+            parsed x, y;
+            memcpy(a, req.data(), req.size());
+            memcpy(b, req.data(), req.size());
+            if (!legacy_parse(a, req.size(), x) || !scanner_parse(b, req.size(), y) || strcmp(x.url, y.url) != 0 ||
+                strcmp(x.host, y.host) != 0 || x.linger != y.linger || x.headers != y.headers)
+            {
+                printf("mismatch with %s on %.40s\n", http_scanner::name((http_scanner::IMPL)impl), req.c_str());
+                return 1;
+            }
+        }
+    }
+
+    long total = 0;
+    for (const std::string &req : requests)
+        total += req.size();
+    printf("%zu requests, %.0f bytes on average, %ld rounds\n", requests.size(), (double)total / requests.size(), rounds);
+    printf("%-22s %12s %12s\n", "parser", "ns/request", "MB/s");
+
+    long bytes;
+    double ns = run(legacy_parse, requests, rounds, bytes);
+    printf("%-22s %12.1f %12.1f\n", "byte loop (original)", ns, total / ns * 1000.0 / requests.size());
+    for (int impl = http_scanner::SCALAR; impl < http_scanner::IMPL_COUNT; ++impl)
+    {
+        if (!http_scanner::use((http_scanner::IMPL)impl))
+        {
+            printf("%-22s %12s\n", http_scanner::name((http_scanner::IMPL)impl), "unsupported");
+            continue;
+        }
+        ns = run(scanner_parse, requests, rounds, bytes);
+        std::string label = std::string("scanner ") + http_scanner::name((http_scanner::IMPL)impl);
+        printf("%-22s %12.1f %12.1f\n", label.c_str(), ns, total / ns * 1000.0 / requests.size());
+    }
+    return 0;
+}
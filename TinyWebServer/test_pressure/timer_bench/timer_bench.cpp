@@ -0,0 +1,216 @@
+//定时器容器基准测试：比较分层时间轮（sort_timer_lst）与原来的最小堆 + 哈希索引在大量连接下的
+//添加、调整、到期处理开销。用法：./timer_bench [连接数...]，默认测试 100000 和 1000000。
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+
+#include "../../timer/lst_timer.h"
+#include "../../http/http_conn.h"
+
+//基准只链接定时器：lst_timer.cpp中的cb_func经http_conn::close_conn关闭连接，这里给出空实现，不链接服务器的其余部分
+void http_conn::close_conn()
+{
+}
+
+//原实现：最小堆 + unordered_map 索引 + 互斥锁，每个连接 new 一个定时器，到期或删除时 delete
+class heap_timer_lst
+{
+public:
+    ~heap_timer_lst()
+    {
+        for (auto timer : timer_heap)
+            delete timer;
+    }
+
+    void add_timer(util_timer *timer)
+    {
+        std::lock_guard<std::mutex> lock(heap_mutex);
+        int index = timer_heap.size();
+        timer_heap.push_back(timer);
+        timer_index_map[timer] = index;
+        heapify_up(index);
+    }
+    void adjust_timer(util_timer *timer)
+    {
+        std::lock_guard<std::mutex> lock(heap_mutex);
+        auto it = timer_index_map.find(timer);
+        if (it == timer_index_map.end())
+            return;
+        int index = it->second;
+        heapify_up(index);
+        heapify_down(index);
+    }
+    void tick(int64_t cur)
+    {
+        std::lock_guard<std::mutex> lock(heap_mutex);
+        while (!timer_heap.empty())
+        {
+            util_timer *timer = timer_heap[0];
+            if (cur < timer->expire)
+                break;
+            int last_index = timer_heap.size() - 1;
+            swap_nodes(0, last_index);
+            util_timer *expired_timer = timer_heap[last_index];
+            timer_heap.pop_back();
+            timer_index_map.erase(expired_timer);
+            if (!timer_heap.empty())
+                heapify_down(0);
+            expired_timer->cb_func(expired_timer->user_data);
+            delete expired_timer;
+        }
+    }
+
+private:
+    void swap_nodes(int i, int j)
+    {
+        if (i == j)
+            return;
+        std::swap(timer_heap[i], timer_heap[j]);
+        timer_index_map[timer_heap[i]] = i;
+        timer_index_map[timer_heap[j]] = j;
+    }
+    void heapify_up(int index)
+    {
+        while (index > 0)
+        {
+            int parent = (index - 1) / 2;
+            if (timer_heap[index]->expire >= timer_heap[parent]->expire)
+                break;
+            swap_nodes(index, parent);
+            index = parent;
+        }
+    }
+    void heapify_down(int index)
+    {
+        int size = timer_heap.size();
+        while (index < size)
+        {
+            int left_child = 2 * index + 1;
+            int right_child = 2 * index + 2;
+            int smallest = index;
+            if (left_child < size && timer_heap[left_child]->expire < timer_heap[smallest]->expire)
+                smallest = left_child;
+            if (right_child < size && timer_heap[right_child]->expire < timer_heap[smallest]->expire)
+                smallest = right_child;
+            if (smallest == index)
+                break;
+            swap_nodes(index, smallest);
+            index = smallest;
+        }
+    }
+
+    std::vector<util_timer *> timer_heap;
+    std::unordered_map<util_timer *, int> timer_index_map;
+    std::mutex heap_mutex;
+};
+
+static long g_expired = 0;// 回调被调用的次数
+static long g_early = 0;// 早于超时时间被处理的定时器数
+static int64_t g_now = 0;// 当前tick推进到的时间
+
+static void bench_cb(client_data *user_data)
+{
+    ++g_expired;
+    if (user_data->node.expire > g_now)
+        ++g_early;
+}
+
+static double elapsed_ns(std::chrono::steady_clock::time_point begin, long ops)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    return (double)ns / ops;
+}
+
+//模拟服务器的使用方式：连接建立时加入请求头超时，之后每个连接各有一次读写活动按长连接空闲超时调整，
+//最后时间推进到所有定时器都到期，tick按1毫秒步进模拟timerfd逐次触发
+template <typename ADD, typename ADJUST, typename TICK>
+static void run(const char *name, int n, int64_t base, const std::vector<int> &jitter, ADD add, ADJUST adjust, TICK tick)
+{
+    g_expired = 0;
+    g_early = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i)
+        add(i, base + 10000 + jitter[i]);
+    double add_ns = elapsed_ns(begin, n);
+
+    begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i)
+        adjust(i, base + 5000 + jitter[(i * 7) % n] * 2);
+    double adjust_ns = elapsed_ns(begin, n);
+
+    begin = std::chrono::steady_clock::now();
+    for (g_now = base; g_now <= base + 25000; ++g_now)
+        tick(g_now);
+    double expire_ns = elapsed_ns(begin, n);
+
+    printf("%-6s n=%-8d add %7.1f ns/op  adjust %7.1f ns/op  expire %7.1f ns/op  (expired %ld, early %ld)\n",
+           name, n, add_ns, adjust_ns, expire_ns, g_expired, g_early);
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(atoi(argv[i]));
+    if (sizes.empty())
+        sizes = {100000, 1000000};
+
+    for (int n : sizes)
+    {
+        std::mt19937 rng(n);
+        std::vector<int> jitter(n);
+        for (int i = 0; i < n; ++i)
+            jitter[i] = rng() % 5000;// 连接建立与活动时间在5秒内随机分布
+
+        //时间轮：节点随client_data数组预先分配
+        {
+            std::vector<client_data> users(n);
+            sort_timer_lst *wheel = new sort_timer_lst;// 槽数组较大，放在堆上
+            int64_t base = current_ms();
+            run("wheel", n, base, jitter,
+                [&](int i, int64_t expire) {
+                    util_timer *timer = &users[i].node;
+                    timer->user_data = &users[i];
+                    timer->cb_func = bench_cb;
+                    timer->expire = expire;
+                    users[i].timer = timer;
+                    wheel->add_timer(timer);
+                },
+                [&](int i, int64_t expire) {
+                    users[i].timer->expire = expire;
+                    wheel->adjust_timer(users[i].timer);
+                },
+                [&](int64_t now) { wheel->tick(now); });
+            delete wheel;
+        }
+
+        //最小堆：每个连接new一个定时器，回调按节点自身的超时时间检查
+        {
+            std::vector<client_data> users(n);
+            heap_timer_lst heap;
+            int64_t base = current_ms();
+            run("heap", n, base, jitter,
+                [&](int i, int64_t expire) {
+                    util_timer *timer = new util_timer;
+                    timer->user_data = &users[i];
+                    timer->cb_func = bench_cb;
+                    timer->expire = expire;
+                    users[i].timer = timer;
+                    users[i].node.expire = expire;
+                    heap.add_timer(timer);
+                },
+                [&](int i, int64_t expire) {
+                    users[i].timer->expire = expire;
+                    users[i].node.expire = expire;
+                    heap.adjust_timer(users[i].timer);
+                },
+                [&](int64_t now) { heap.tick(now); });
+        }
+    }
+    return 0;
+}
@@ -7,14 +7,13 @@
 #include <thread>
 #include <vector>
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
 
 template <typename T>
 class threadpool
 {
 public:
     /*thread_number是线程池中线程的数量，max_requests是请求队列中最多允许的、等待处理的请求的数量*/
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    threadpool(int actor_model, int thread_number = 8, int max_request = 10000);
     ~threadpool();
     bool append(T *request, int state);
     bool append_p(T *request);
@@ -27,14 +26,20 @@ private:
     int m_thread_number;        //线程池中的线程数
     int m_max_requests;         //请求队列中允许的最大请求数
     std::vector<std::thread> m_threads; // 工作线程
-    std::list<T *> m_workqueue; //请求队列
+    //交给线程池时连接的代数与fd，连接在处理期间被关闭时，事件循环据此丢弃投递并找到连接归还资源
+    struct task
+    {
+        T *request;
+        unsigned generation;
+        int sockfd;
+    };
+    std::list<task> m_workqueue; //请求队列
     locker m_queuelocker;       //保护请求队列的互斥锁
     sem m_queuestat;            //是否有任务需要处理（信号量）,自定义的信号量包装类，工作线程在队列为空时等待，有任务时被唤醒
-    connection_pool *m_connPool;  //数据库连接池，工作线程处理请求时可以从连接池获取数据库连接
     int m_actor_model;          //模型切换，0表示Proactor模式，1表示Reactor模式
 };
 template <typename T>
-threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int thread_number, int max_requests) : m_actor_model(actor_model),m_thread_number(thread_number), m_max_requests(max_requests), m_connPool(connPool)
+threadpool<T>::threadpool( int actor_model, int thread_number, int max_requests) : m_actor_model(actor_model),m_thread_number(thread_number), m_max_requests(max_requests)
 {
     if (thread_number <= 0 || max_requests <= 0)
         throw std::exception();
@@ -66,7 +71,8 @@ bool threadpool<T>::append(T *request, int state)//向请求队列中添加任
         return false;
     }
     request->m_state = state;//设置请求状态(读/写)
-    m_workqueue.push_back(request);//将请求加入队列
+    request->m_in_pool = true;
+    m_workqueue.push_back(task{request, request->generation(), request->get_sockfd()});//将请求加入队列，代数在事件循环中读取，此时连接不会被关闭
     m_queuelocker.unlock();//解锁
     m_queuestat.post();//通知工作线程
     return true;
@@ -82,7 +88,8 @@ bool threadpool<T>::append_p(T *request)//向请求队列中添加任务（Proac
         m_queuelocker.unlock();
         return false;
     }
-    m_workqueue.push_back(request);
+    request->m_in_pool = true;
+    m_workqueue.push_back(task{request, request->generation(), request->get_sockfd()});
     m_queuelocker.unlock();
     m_queuestat.post();
     return true;
@@ -100,45 +107,42 @@ void threadpool<T>::run()
             m_queuelocker.unlock();
             continue;
         }
-        T *request = m_workqueue.front();// 获取任务
+        task item = m_workqueue.front();// 获取任务
         m_workqueue.pop_front();// 移除任务
         m_queuelocker.unlock();// 解锁
+        T *request = item.request;
         if (!request)
             continue;
+        completion_queue *cq = request->m_cq;
+        bool ok = true;
+        T::t_rearm_ev = 0;// 处理期间不重新注册事件，记下要注册的事件交给事件循环
         if (1 == m_actor_model)// Reactor模式
         {
             if (0 == request->m_state)// 读事件
             {
-                if (request->read_once())// 读取数据
-                {
-                    request->improv = 1;
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
+                ok = request->read_once();// 读取数据
+                if (ok)
                     request->process();// 处理请求
-                }
-                else
-                {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
             }
             else// 写事件
             {
-                if (request->write())// 写入数据
-                {
-                    request->improv = 1;
-                }
+                if (request->has_pending_request())// 上一批响应已发完，流水线中剩下的请求已在读缓冲区中，直接解析
+                    request->process();
                 else
-                {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                    ok = request->write();// 写入数据
             }
         }
         else// Proactor模式
-        {
-            connectionRAII mysqlcon(&request->mysql, m_connPool);
             request->process();// 处理请求
-        }
+        int ev = T::t_rearm_ev;
+        T::t_rearm_ev = -1;
+        //事件尚未重新注册，连接仍只属于本线程，此时读取的超时阶段不会与其他线程竞争；
+        //没有要注册的事件说明请求已挂起，结果随时可能交回，不再访问连接
+        int state = -1;// 读写失败，由事件循环关闭连接
+        if (ok)
+            state = ev ? request->timeout_state() : T::TIMEOUT_PENDING;
+        request->m_in_pool = false;
+        cq->post(item.sockfd, ev, state, item.generation);
     }
 }
 #endif
@@ -1,202 +1,266 @@
 #include "lst_timer.h"
 #include "../http/http_conn.h"
 
-sort_timer_lst::sort_timer_lst()//初始化堆
+sort_timer_lst::sort_timer_lst()//各槽的哨兵节点指向自身，表示空链表
 {
-    // vector和unordered_map会自动初始化为空
+    for (int i = 0; i < ROOT_SIZE; ++i)
+    {
+        m_root[i].prev = m_root[i].next = &m_root[i];
+    }
+    for (int level = 0; level < LEVELS; ++level)
+    {
+        for (int i = 0; i < LEVEL_SIZE; ++i)
+        {
+            m_levels[level][i].prev = m_levels[level][i].next = &m_levels[level][i];
+        }
+    }
+    m_current = current_ms();
+    m_count = 0;
 }
 
-sort_timer_lst::~sort_timer_lst()//清空堆并删除所有定时器节点，释放内存
+sort_timer_lst::~sort_timer_lst()//节点归调用方所有，这里只把它们摘下
 {
-    std::lock_guard<std::mutex> lock(heap_mutex);
-    for (auto timer : timer_heap)
+    for (int i = 0; i < ROOT_SIZE; ++i)
     {
-        delete timer;
+        while (m_root[i].next != &m_root[i])
+            unlink(m_root[i].next);
+    }
+    for (int level = 0; level < LEVELS; ++level)
+    {
+        for (int i = 0; i < LEVEL_SIZE; ++i)
+        {
+            while (m_levels[level][i].next != &m_levels[level][i])
+                unlink(m_levels[level][i].next);
+        }
     }
-    timer_heap.clear();
-    timer_index_map.clear();
 }
 
-void sort_timer_lst::swap_nodes(int i, int j)//交换两个节点并更新索引映射
+void sort_timer_lst::link(util_timer *head, util_timer *timer)
 {
-    if (i == j) return;
-    
-    // 交换vector中的节点
-    std::swap(timer_heap[i], timer_heap[j]);
-    
-    // 更新索引映射
-    timer_index_map[timer_heap[i]] = i;
-    timer_index_map[timer_heap[j]] = j;
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
 }
 
-void sort_timer_lst::heapify_up(int index)//向上调整堆
+void sort_timer_lst::unlink(util_timer *timer)
 {
-    while (index > 0)
-    {
-        int parent = get_parent(index);
-        if (timer_heap[index]->expire >= timer_heap[parent]->expire)
-        {
-            break; // 堆性质已满足
-        }
-        swap_nodes(index, parent);
-        index = parent;
-    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
 }
 
-void sort_timer_lst::heapify_down(int index)//向下调整堆
+void sort_timer_lst::place(util_timer *timer)//按距当前时间的远近选择层，再按超时时间在该层的位选择槽
 {
-    int size = timer_heap.size();
-    while (index < size)
+    int64_t expire = timer->expire;
+    int64_t idx = expire - m_current;
+    util_timer *head;
+
+    if (idx < 0)
     {
-        int left_child = get_left_child(index);
-        int right_child = get_right_child(index);
-        int smallest = index;
-        
-        // 找到最小的子节点
-        if (left_child < size && timer_heap[left_child]->expire < timer_heap[smallest]->expire)
-        {
-            smallest = left_child;
-        }
-        if (right_child < size && timer_heap[right_child]->expire < timer_heap[smallest]->expire)
+        //已经超时，挂到当前槽，下一次tick立即处理
+        head = &m_root[m_current & (ROOT_SIZE - 1)];
+    }
+    else if (idx < ROOT_SIZE)
+    {
+        head = &m_root[expire & (ROOT_SIZE - 1)];
+    }
+    else
+    {
+        int level = 0;
+        while (level < LEVELS - 1 && idx >= ((int64_t)1 << (ROOT_BITS + (level + 1) * LEVEL_BITS)))
         {
-            smallest = right_child;
+            ++level;
         }
-        
-        if (smallest == index)
+        //超出时间轮范围的挂到最高层最远的槽，级联时会按真实的超时时间重新分配
+        int64_t span = (int64_t)1 << (ROOT_BITS + LEVELS * LEVEL_BITS);
+        if (idx >= span)
         {
-            break; // 堆性质已满足
+            expire = m_current + span - 1;
         }
-        
-        swap_nodes(index, smallest);
-        index = smallest;
+        head = &m_levels[level][(expire >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1)];
     }
+    link(head, timer);
 }
 
-void sort_timer_lst::add_timer(util_timer *timer)//向堆中添加定时器，保持按超时时间升序排列。
+int sort_timer_lst::cascade(int level, int index)
 {
-    if (!timer)//检查定时器是否有效
+    util_timer *head = &m_levels[level][index];
+    while (head->next != head)
     {
-        return;
+        util_timer *timer = head->next;
+        unlink(timer);
+        place(timer);
     }
-    
-    std::lock_guard<std::mutex> lock(heap_mutex);
-    
-    // 重置删除标记
-    timer->deleted = false;
-    
-    // 将定时器添加到vector末尾
-    int index = timer_heap.size();
-    timer_heap.push_back(timer);
-    timer_index_map[timer] = index;
-    
-    // 向上调整堆
-    heapify_up(index);
+    return index;
 }
-void sort_timer_lst::adjust_timer(util_timer *timer)//调整定时器位置
+
+void sort_timer_lst::add_timer(util_timer *timer)//将定时器挂到时间轮上
 {
     if (!timer)//检查定时器是否有效
     {
         return;
     }
-    
-    std::lock_guard<std::mutex> lock(heap_mutex);
-    
-    // 查找定时器在堆中的位置
-    auto it = timer_index_map.find(timer);
-    if (it == timer_index_map.end())
+
+    //时间轮空闲期间没有tick推进当前时间，先追上当前时间，避免下次tick逐毫秒走过整个空闲期
+    if (0 == m_count)
+    {
+        int64_t now = current_ms();
+        if (now > m_current)
+            m_current = now;
+    }
+
+    if (timer->linked())
     {
-        return; // 定时器不在堆中
+        unlink(timer);
+        --m_count;
     }
-    
-    int index = it->second;
-    
-    // 向上和向下调整堆，恢复堆性质
-    heapify_up(index);
-    heapify_down(index);
+    timer->deadline = timer->expire;
+    place(timer);
+    ++m_count;
 }
-void sort_timer_lst::del_timer(util_timer *timer)//从堆中删除定时器
+void sort_timer_lst::adjust_timer(util_timer *timer)//超时时间修改后从原槽摘下，重新挂到对应的槽
 {
-    if (!timer)//检查定时器是否有效
+    if (!timer || !timer->linked())//检查定时器是否有效
+    {
+        return; // 定时器不在时间轮上
+    }
+
+    timer->deadline = timer->expire;
+    unlink(timer);
+    place(timer);
+}
+void sort_timer_lst::refresh_timer(util_timer *timer, int64_t deadline)
+{
+    if (!timer || !timer->linked())
     {
         return;
     }
-    
-    std::lock_guard<std::mutex> lock(heap_mutex);
-    
-    // 查找定时器在堆中的位置
-    auto it = timer_index_map.find(timer);
-    if (it == timer_index_map.end())
+
+    //推迟超时只记录时间，节点留在原槽，到期时tick发现deadline更晚再重新挂载；
+    //提前超时（如从发送阶段进入长连接空闲）必须立即移动，否则会晚于deadline关闭
+    timer->deadline = deadline;
+    if (deadline < timer->expire)
     {
-        return; // 定时器不在堆中
+        timer->expire = deadline;
+        unlink(timer);
+        place(timer);
     }
-    
-    int index = it->second;
-    int last_index = timer_heap.size() - 1;
-    
-    // 将待删除的节点与最后一个节点交换
-    swap_nodes(index, last_index);
-    
-    // 删除最后一个节点（即原来的待删除节点）
-    timer_heap.pop_back();
-    timer_index_map.erase(timer);
-    
-    // 如果删除的不是最后一个节点，需要调整堆
-    if (index < last_index)
+}
+void sort_timer_lst::del_timer(util_timer *timer)//从时间轮上摘下定时器
+{
+    if (!timer || !timer->linked())//检查定时器是否有效
     {
-        // 从删除位置向上和向下调整堆
-        heapify_up(index);
-        heapify_down(index);
+        return; // 定时器不在时间轮上
     }
-    
-    // 删除定时器对象
-    delete timer;
+
+    unlink(timer);
+    --m_count;
 }
-void sort_timer_lst::tick()//处理超时定时器
+void sort_timer_lst::tick(int64_t now)//逐毫秒推进当前时间，处理沿途到期的槽
 {
-    std::lock_guard<std::mutex> lock(heap_mutex);
-    
-    if (timer_heap.empty())//检查堆是否为空
+    //时间轮为空时直接跳到now之后
+    if (0 == m_count)
     {
+        if (now >= m_current)
+            m_current = now + 1;
         return;
     }
-    
-    time_t cur = time(nullptr);//获取当前时间
-    
-    // 处理所有超时的定时器
-    while (!timer_heap.empty())
+
+    while (m_current <= now)
     {
-        util_timer *timer = timer_heap[0]; // 堆顶元素
-        
-        // 如果堆顶定时器未超时，说明后面的定时器也都未超时
-        if (cur < timer->expire)
+        int index = m_current & (ROOT_SIZE - 1);
+
+        //第0层转完一圈，从第1层当前槽级联；第1层也转完一圈时继续向更高层级联
+        if (0 == index)
         {
-            break;
+            for (int level = 0; level < LEVELS; ++level)
+            {
+                int slot = (m_current >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+                if (0 != cascade(level, slot))
+                    break;
+            }
         }
-        
-        // 删除堆顶定时器（与最后一个节点交换后删除）
-        int last_index = timer_heap.size() - 1;
-        swap_nodes(0, last_index);
-        
-        util_timer *expired_timer = timer_heap[last_index];
-        timer_heap.pop_back();
-        timer_index_map.erase(expired_timer);
-        
-        // 如果堆不为空，调整堆顶
-        if (!timer_heap.empty())
+        ++m_current;
+
+        // 执行该槽中所有定时器的回调函数，节点摘下后由调用方复用
+        util_timer *head = &m_root[index];
+        while (head->next != head)
         {
-            heapify_down(0);
+            util_timer *timer = head->next;
+            unlink(timer);
+
+            //挂载之后连接有过活动，按最新的超时时间重新挂载（m_current已前进，不会挂回本槽）
+            if (timer->deadline > now)
+            {
+                timer->expire = timer->deadline;
+                place(timer);
+                continue;
+            }
+
+            --m_count;
+            timer->cb_func(timer->user_data);
         }
-        
-        // 执行超时定时器的回调函数并删除
-        expired_timer->cb_func(expired_timer->user_data);
-        delete expired_timer;
     }
 }
+int64_t sort_timer_lst::next_expire() const
+{
+    if (0 == m_count)
+    {
+        return -1;
+    }
+
+    //第0层每个槽对应1毫秒，第一个非空槽即最早的超时时间
+    for (int64_t t = m_current; t < m_current + ROOT_SIZE; ++t)
+    {
+        const util_timer *head = &m_root[t & (ROOT_SIZE - 1)];
+        if (head->next != head)
+            return t;
+    }
+
+    //第0层为空：恰在一圈起点时级联尚未进行；否则取第1层第一个非空槽的级联时间，
+    //更高层只返回第1层下一圈的起点，到时级联后再重新计算
+    if (0 == (m_current & (ROOT_SIZE - 1)))
+    {
+        return m_current;
+    }
+    int64_t block = m_current >> ROOT_BITS;
+    for (int k = 1; k <= LEVEL_SIZE; ++k)
+    {
+        const util_timer *head = &m_levels[0][(block + k) & (LEVEL_SIZE - 1)];
+        if (head->next != head)
+            return (block + k) << ROOT_BITS;
+    }
+    return ((m_current >> (ROOT_BITS + LEVEL_BITS)) + 1) << (ROOT_BITS + LEVEL_BITS);
+}
+
+Utils::~Utils()
+{
+    if (m_timerfd != -1)
+        close(m_timerfd);
+}
 
+int Utils::init_timerfd()//创建非阻塞的timerfd，初始为未设定状态
+{
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    m_armed = 0;
+    return m_timerfd;
+}
 
-void Utils::init(int timeslot)//初始化时间槽，设置定时器超时单位
+void Utils::arm_timer(int64_t expire)
 {
-    m_TIMESLOT = timeslot;
+    //已设定的时间不晚于expire时无需重设；timerfd提前触发也无妨，timer_handler会按堆顶重新设定
+    if (m_timerfd == -1 || (m_armed != 0 && m_armed <= expire))
+        return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    int64_t when = expire > 0 ? expire : 1;// 全0的it_value表示取消定时
+    its.it_value.tv_sec = when / 1000;
+    its.it_value.tv_nsec = (when % 1000) * 1000000;
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+    m_armed = when;
 }
 
 //对文件描述符设置非阻塞
@@ -247,11 +311,19 @@ void Utils::addsig(int sig, void(handler)(int), bool restart)
     assert(sigaction(sig, &sa, NULL) != -1);//注册信号处理函数
 }
 
-//定时处理任务，重新定时以不断触发SIGALRM信号
+//定时处理任务，处理完超时定时器后按最早的超时时间重新设定timerfd
 void Utils::timer_handler()
 {
-    m_timer_lst.tick();//调用定时器链表的 tick 方法处理超时定时器
-    alarm(m_TIMESLOT);//重新设置定时器，持续触发 SIGALRM 信号
+    uint64_t expirations;
+    read(m_timerfd, &expirations, sizeof(expirations));//读走计数，避免LT模式下反复触发
+    m_armed = 0;
+
+    refresh_clock();
+    m_timer_lst.tick(m_now);//推进时间轮，处理超时定时器
+
+    int64_t next = m_timer_lst.next_expire();
+    if (next >= 0)
+        arm_timer(next);
 }
 
 void Utils::show_error(int connfd, const char *info)
@@ -261,14 +333,12 @@ void Utils::show_error(int connfd, const char *info)
 }
 
 int *Utils::u_pipefd = nullptr;
-int Utils::u_epollfd = 0;
 
 class Utils;
 void cb_func(client_data *user_data)//定时器超时时的回调函数，关闭客户端连接并从epoll中移除。
 {
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);//从 epoll 实例中移除文件描述符
     assert(user_data);
-    close(user_data->sockfd);//关闭 socket 连接
-    http_conn::m_user_count--;//减少用户计数
+    user_data->conn->close_conn();//从所属反应堆的 epoll 实例中移除并关闭 socket，减少用户计数
+    user_data->timer = nullptr;//定时器随后被释放，避免迟到的完成通知访问已释放的定时器
 }
 
@@ -20,6 +20,8 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/timerfd.h>
+#include <stdint.h>
 #include <vector>
 #include <mutex>
 #include <unordered_map>
@@ -27,61 +29,89 @@
 #include <time.h>
 #include "../log/log.h"
 
-class util_timer;
+struct client_data;
+class http_conn;
 
-struct client_data
+//单调时钟的当前毫秒数，不受系统时间调整影响，定时器的超时时间都以它为基准
+inline int64_t current_ms()
 {
-    sockaddr_in address;// 客户端socket地址
-    int sockfd;// 客户端socket文件描述符
-    util_timer *timer;// 指向对应定时器的指针
-};
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-class util_timer//定时器节点类，包含超时时间、回调函数和链表指针。
+class util_timer//定时器节点类，包含超时时间、回调函数和所在时间轮槽的链表指针。
 {
 public:
-    util_timer() : prev(nullptr), next(nullptr), deleted(false) {}
+    util_timer() : expire(0), deadline(0), cb_func(nullptr), user_data(nullptr), prev(nullptr), next(nullptr) {}
+
+    bool linked() const { return next != nullptr; }// 是否挂在时间轮上
 
 public:
-    time_t expire; // 定时器超时时间（绝对时间）
+    int64_t expire; // 定时器在时间轮上挂载的超时时间（current_ms()下的绝对毫秒数）
+    int64_t deadline; // 连接实际的超时时间，活动时只更新它，晚于expire时到期后再按它重新挂载
     
     void (* cb_func)(client_data *);// 回调函数指针，用于处理超时
     client_data *user_data;// 指向客户端数据的指针
-    util_timer *prev;// 指向前一个定时器（保留用于兼容性，但不再使用）
-    util_timer *next;// 指向后一个定时器（保留用于兼容性，但不再使用）
-    bool deleted; // 标记是否已删除，用于延迟删除
+    util_timer *prev;// 槽内双向循环链表的前一个节点，未挂在时间轮上时为空
+    util_timer *next;// 槽内双向循环链表的后一个节点，未挂在时间轮上时为空
+};
+
+struct client_data
+{
+    sockaddr_in address;// 客户端socket地址
+    int sockfd;// 客户端socket文件描述符
+    http_conn *conn;// 对应的HTTP连接，超时或出错时经它的close_conn关闭
+    util_timer *timer;// 指向对应定时器的指针，连接关闭后为空
+    util_timer node;// 定时器节点随client_data数组一起预先分配，连接建立时无需new
 };
 
+//分层时间轮：第0层256个槽、精度1毫秒，其上4层各64个槽，每层的一个槽覆盖下一层一整圈，共覆盖2^32毫秒。
+//定时器按距当前时间的远近挂到对应层的槽中，添加、调整、删除都只是O(1)的链表操作；
+//时间推进到第0层一圈的起点时，把上层对应槽中的定时器重新分配到下层（级联）。
+//节点由调用方持有，时间轮不分配也不释放节点；每个时间轮只由所属事件循环线程访问，不加锁。
 class sort_timer_lst
 {
 public:
-    sort_timer_lst();//构造函数：初始化堆
-    ~sort_timer_lst();//析构函数：清空堆并删除所有定时器节点
+    sort_timer_lst();//构造函数：初始化各槽的哨兵节点，当前时间取current_ms()
+    ~sort_timer_lst();//析构函数：摘下仍在时间轮上的节点
 
     void add_timer(util_timer *timer);// 添加定时器
-    void adjust_timer(util_timer *timer);// 调整定时器位置
-    void del_timer(util_timer *timer);// 删除定时器
-    void tick();// 处理超时定时器
+    void adjust_timer(util_timer *timer);// expire修改后重新挂到对应的槽
+    void refresh_timer(util_timer *timer, int64_t deadline);// 连接有活动时更新超时时间，只有提前时才移动节点
+    void del_timer(util_timer *timer);// 删除定时器（只摘下节点）
+    void tick(int64_t now);// 推进到now并执行所有expire不晚于now的定时器
+    int64_t next_expire() const;// 最早超时时间的下界（在上层时为所在槽的起始时间），时间轮为空时返回-1
+    int size() const { return m_count; }// 时间轮上的定时器数量
 
 private:
-    void heapify_up(int index);// 向上调整堆
-    void heapify_down(int index);// 向下调整堆
-    void swap_nodes(int i, int j);// 交换两个节点并更新索引映射
-    int get_parent(int index) const { return (index - 1) / 2; }// 获取父节点索引
-    int get_left_child(int index) const { return 2 * index + 1; }// 获取左子节点索引
-    int get_right_child(int index) const { return 2 * index + 2; }// 获取右子节点索引
-    
-    std::vector<util_timer*> timer_heap;// 定时器堆（vector实现）
-    std::unordered_map<util_timer*, int> timer_index_map;// 定时器到索引的映射
-    std::mutex heap_mutex;// 互斥锁，保护堆操作
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVELS = 4;
+
+    void place(util_timer *timer);// 按超时时间挂到对应层的槽
+    int cascade(int level, int index);// 把上层一个槽中的定时器重新分配到下层，返回槽下标
+    static void link(util_timer *head, util_timer *timer);// 挂到槽的链表尾部
+    static void unlink(util_timer *timer);// 从所在槽的链表中摘下
+
+    util_timer m_root[ROOT_SIZE];// 第0层，每个槽对应1毫秒
+    util_timer m_levels[LEVELS][LEVEL_SIZE];// 第1~4层
+    int64_t m_current;// 下一个待处理的毫秒
+    int m_count;// 时间轮上的定时器数量
 };
 
 class Utils//工具类，提供信号处理、文件描述符设置和定时器管理等功能
 {
 public:
-    Utils() {}
-    ~Utils() {}
+    Utils() : m_timerfd(-1), m_armed(0), m_now(current_ms()) {}
+    ~Utils();
+
+    int init_timerfd();// 创建timerfd，返回其描述符，由调用方注册到自己的epoll或io_uring中
 
-    void init(int timeslot);// 初始化时间槽
+    //保证timerfd不晚于expire触发，只在出现更早的超时时间时才调用timerfd_settime
+    void arm_timer(int64_t expire);
 
     //对文件描述符设置非阻塞
     int setnonblocking(int fd);
@@ -95,16 +125,20 @@ public:
     //设置信号函数
     void addsig(int sig, void(handler)(int), bool restart = true);
 
-    //定时处理任务，重新定时以不断触发SIGALRM信号
+    //timerfd可读时调用：处理超时定时器，并按最早的超时时间重新设定timerfd
     void timer_handler();
 
+    //每轮事件循环开始时缓存当前时间，本轮内刷新定时器都使用它，避免每次读写都读取时钟
+    void refresh_clock() { m_now = current_ms(); }
+
     void show_error(int connfd, const char *info);// 显示错误信息
 
 public:
     static int *u_pipefd;// 管道文件描述符（用于统一事件源）
     sort_timer_lst m_timer_lst;// 定时器链表
-    static int u_epollfd;// epoll文件描述符
-    int m_TIMESLOT;// 时间槽（定时器超时单位）
+    int m_timerfd;// 驱动定时器的timerfd（CLOCK_MONOTONIC）
+    int64_t m_armed;// timerfd当前设定的超时时间，0表示未设定
+    int64_t m_now;// 本轮事件循环缓存的当前时间
 };
 
 void cb_func(client_data *user_data);//定时器超时时的回调函数，关闭客户端连接并从epoll中移除。
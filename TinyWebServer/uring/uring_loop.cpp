@@ -0,0 +1,249 @@
+#include <poll.h>
+#include "uring_loop.h"
+
+uring_loop *uring_loop::u_loop = nullptr;
+
+uring_loop::uring_loop()
+{
+    m_ringfd = -1;
+    m_entries = 0;
+    m_sq_ptr = MAP_FAILED;
+    m_sq_size = 0;
+    m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    m_sqes_size = 0;
+    m_sq_local_tail = 0;
+    m_cq_ptr = MAP_FAILED;
+    m_cq_size = 0;
+    m_buf_ring = (struct io_uring_buf_ring *)MAP_FAILED;
+    m_buf_ring_size = 0;
+    m_buf_count = 0;
+    m_buf_size = 0;
+    m_max_fd = 0;
+}
+
+uring_loop::~uring_loop()
+{
+    if (u_loop == this)
+        u_loop = nullptr;
+    if (m_buf_ring != MAP_FAILED)
+        munmap(m_buf_ring, m_buf_ring_size);
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_size);
+    if (m_sq_ptr != MAP_FAILED)
+        munmap(m_sq_ptr, m_sq_size);
+    if (m_ringfd != -1)
+        close(m_ringfd);
+}
+
+bool uring_loop::init(unsigned entries, int max_fd, unsigned buf_count, unsigned buf_size)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ringfd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_ringfd < 0)
+    {
+        m_ringfd = -1;
+        return false;
+    }
+    m_entries = params.sq_entries;
+
+    //映射提交队列、完成队列和提交项数组，新内核上两个队列共用一次映射
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        m_sq_size = m_sq_size > m_cq_size ? m_sq_size : m_cq_size;
+        m_cq_size = m_sq_size;
+    }
+
+    m_sq_ptr = mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED)
+        return false;
+    if (single_mmap)
+        m_cq_ptr = m_sq_ptr;
+    else
+    {
+        m_cq_ptr = mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED)
+            return false;
+    }
+    m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + params.sq_off.array);
+    m_sq_local_tail = *m_sq_tail;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    //注册 provided buffer ring（5.19+），同一版本内核也开始支持 multishot accept，注册失败即视为不支持
+    m_buf_count = buf_count;
+    m_buf_size = buf_size;
+    m_buf_ring_size = buf_count * sizeof(struct io_uring_buf);
+    m_buf_ring = (struct io_uring_buf_ring *)mmap(0, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (m_buf_ring == MAP_FAILED)
+        return false;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)m_buf_ring;
+    reg.ring_entries = buf_count;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, m_ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return false;
+
+    m_bufs.reset(new char[(size_t)buf_count * buf_size]);
+    m_buf_ring->tail = 0;
+    for (unsigned i = 0; i < buf_count; ++i)
+        recycle(i);
+
+    m_max_fd = max_fd;
+    m_gen.reset(new unsigned[max_fd]());
+    if (m_posted.notifyfd() == -1)
+        return false;
+
+    u_loop = this;
+    return true;
+}
+
+void uring_loop::recycle(int bid)
+{
+    //ring 的 tail 与第0项的 resv 重叠，只能逐字段写入；
+    //C++ 中 __DECLARE_FLEX_ARRAY 的空结构体占1字节，bufs 成员会错位，因此直接按 io_uring_buf 数组寻址
+    unsigned short tail = m_buf_ring->tail;
+    struct io_uring_buf *buf = (struct io_uring_buf *)m_buf_ring + (tail & (m_buf_count - 1));
+    buf->addr = (uint64_t)buffer(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    __atomic_store_n(&m_buf_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+uint64_t uring_loop::encode(OP_TYPE type, int fd) const
+{
+    uint64_t gen = (fd >= 0 && fd < m_max_fd) ? (m_gen[fd] & 0xffffff) : 0;
+    return ((uint64_t)type << 56) | (gen << 32) | (uint32_t)fd;
+}
+
+bool uring_loop::is_stale(uint64_t user_data) const
+{
+    int fd = op_fd(user_data);
+    if (fd < 0 || fd >= m_max_fd)
+        return false;
+    return ((user_data >> 32) & 0xffffff) != (m_gen[fd] & 0xffffff);
+}
+
+void uring_loop::retire(int fd)
+{
+    if (fd >= 0 && fd < m_max_fd)
+        ++m_gen[fd];
+    shutdown(fd, SHUT_RDWR);
+}
+
+int uring_loop::enter(unsigned to_submit, unsigned min_complete)
+{
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    return syscall(__NR_io_uring_enter, m_ringfd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+struct io_uring_sqe *uring_loop::get_sqe()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sq_local_tail - head >= m_entries)
+    {
+        //提交队列已满，先把已准备的提交项交给内核
+        enter(m_sq_local_tail - head, 0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sq_local_tail - head >= m_entries)
+            return nullptr;
+    }
+    unsigned index = m_sq_local_tail & *m_sq_mask;
+    struct io_uring_sqe *sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    ++m_sq_local_tail;
+    return sqe;
+}
+
+void uring_loop::prep_accept(int listenfd)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;// 一次提交，持续产生新连接
+    sqe->user_data = encode(OP_ACCEPT, listenfd);
+}
+
+void uring_loop::prep_recv(int fd)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;// 数据到达时才由内核从缓冲区组中选取缓冲区
+    sqe->buf_group = 0;
+    sqe->user_data = encode(OP_RECV, fd);
+}
+
+void uring_loop::prep_send(int fd, struct msghdr *msg)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = encode(OP_SEND, fd);
+}
+
+void uring_loop::prep_poll(int fd, OP_TYPE type)
+{
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = encode(type, fd);
+}
+
+int uring_loop::submit_and_wait()
+{
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    return enter(m_sq_local_tail - head, 1);
+}
+
+bool uring_loop::peek(struct io_uring_cqe *cqe)
+{
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+    *cqe = m_cqes[head & *m_cq_mask];
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void uring_cb_func(client_data *user_data)
+{
+    if (uring_loop::u_loop)
+        uring_loop::u_loop->retire(user_data->sockfd);
+    cb_func(user_data);
+}
@@ -0,0 +1,112 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <utility>
+
+#include "../lock/locker.h"
+#include "../timer/lst_timer.h"
+
+//io_uring事件循环：用一个环完成 multishot accept、provided buffer recv 和 sendmsg，
+//代替 epoll_wait + recv/writev + epoll_ctl 的组合，一次长连接请求只需要两三个环操作。
+//只使用内核提供的原始系统调用，不依赖 liburing，内核不支持时 init 返回 false，由调用方回退到 epoll。
+class uring_loop
+{
+public:
+    //提交项类型，编码在 user_data 的高 8 位
+    enum OP_TYPE
+    {
+        OP_ACCEPT = 1,// 监听socket上的 multishot accept
+        OP_RECV,// 连接上的 recv（由内核从 provided buffer 中选取缓冲区）
+        OP_SEND,// 连接上的 sendmsg（响应头与文件内容一次提交）
+        OP_SIGNAL,// 信号管道可读
+        OP_NOTIFY,// 工作线程通过 eventfd 投递了重新注册请求
+        OP_TIMER// 定时器的 timerfd 到期
+    };
+
+public:
+    uring_loop();
+    ~uring_loop();
+
+    //创建环并注册 provided buffer ring，buf_count 必须是2的幂
+    bool init(unsigned entries, int max_fd, unsigned buf_count, unsigned buf_size);
+
+    //准备各类提交项，真正的提交在 submit_and_wait 中统一完成
+    void prep_accept(int listenfd);
+    void prep_recv(int fd);
+    void prep_send(int fd, struct msghdr *msg);
+    void prep_poll(int fd, OP_TYPE type);
+
+    int submit_and_wait();// 提交全部提交项并等待至少一个完成事件
+    bool peek(struct io_uring_cqe *cqe);// 取出一个完成事件（拷贝后立即归还给内核）
+
+    char *buffer(int bid) { return m_bufs.get() + (size_t)bid * m_buf_size; }// provided buffer 的地址
+    void recycle(int bid);// 将 provided buffer 归还给内核
+
+    //user_data 编码：类型 | 连接代数 | fd，代数用于丢弃已关闭fd被复用后迟到的完成事件
+    static OP_TYPE op_type(uint64_t user_data) { return (OP_TYPE)(user_data >> 56); }
+    static int op_fd(uint64_t user_data) { return (int)(user_data & 0xffffffff); }
+    bool is_stale(uint64_t user_data) const;
+    void retire(int fd);// 连接即将关闭：推进代数并shutdown，使挂起的recv/send尽快完成
+
+    //工作线程经它投递 (fd, 事件, 超时阶段, 连接代数)：fd 需要重新接收(EPOLLIN)或发送响应(EPOLLOUT)，经 eventfd 通知环所在线程
+    completion_queue &posted() { return m_posted; }
+    bool take_posted(std::list<completion> &posted) { return m_posted.take(posted); }// 环所在线程取出全部投递
+    int notifyfd() const { return m_posted.notifyfd(); }
+
+public:
+    static uring_loop *u_loop;// 当前进程使用的环，供定时器回调访问
+
+private:
+    struct io_uring_sqe *get_sqe();
+    uint64_t encode(OP_TYPE type, int fd) const;
+    int enter(unsigned to_submit, unsigned min_complete);
+
+private:
+    int m_ringfd;// io_uring 实例
+    unsigned m_entries;// 提交队列长度
+
+    //提交队列（与内核共享）
+    void *m_sq_ptr;
+    size_t m_sq_size;
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_mask;
+    unsigned *m_sq_array;
+    struct io_uring_sqe *m_sqes;
+    size_t m_sqes_size;
+    unsigned m_sq_local_tail;// 已准备但尚未提交的尾指针
+
+    //完成队列（与内核共享）
+    void *m_cq_ptr;
+    size_t m_cq_size;
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned *m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+
+    //provided buffer ring
+    struct io_uring_buf_ring *m_buf_ring;
+    size_t m_buf_ring_size;
+    unsigned m_buf_count;
+    unsigned m_buf_size;
+    std::unique_ptr<char[]> m_bufs;
+
+    std::unique_ptr<unsigned[]> m_gen;// 每个fd当前的连接代数
+    int m_max_fd;
+
+    completion_queue m_posted;// 工作线程投递的 (fd, 事件, 超时阶段, 连接代数)
+};
+
+void uring_cb_func(client_data *user_data);//io_uring后端的定时器超时回调，先 retire 再按 cb_func 关闭连接
+
+#endif
@@ -1,11 +1,7 @@
 #include "webserver.h"
 
-WebServer::WebServer()//构造函数：初始化 HTTP 连接数组、设置根目录路径、创建定时器数组
+WebServer::WebServer() : users(MAX_FD), users_timer(MAX_FD)//构造函数：连接表只分配索引，连接对象在接收连接时才从slab中分配
 {
-    //http_conn类对象
-    users_buf_ = std::unique_ptr<http_conn[]>(new http_conn[MAX_FD]);// 创建 HTTP 连接数组，每个元素对应一个客户端连接
-    users = users_buf_.get();// 获取 HTTP 连接数组的指针
-
     //root文件夹路径
     char server_path[200];
     getcwd(server_path, 200);
@@ -14,9 +10,10 @@ WebServer::WebServer()//构造函数：初始化 HTTP 连接数组、设置根
     m_root_storage_ += root;
     m_root = const_cast<char*>(m_root_storage_.c_str());
 
-    //定时器
-    users_timer_buf_ = std::unique_ptr<client_data[]>(new client_data[MAX_FD]);
-    users_timer = users_timer_buf_.get();
+    m_reactors = nullptr;
+    m_reactor_num = 0;
+    m_next_reactor = 0;
+    m_stop = false;
 }
 
 WebServer::~WebServer()
@@ -25,12 +22,18 @@ WebServer::~WebServer()
     close(m_listenfd);
     close(m_pipefd[1]);
     close(m_pipefd[0]);
-    // 智能指针自动释放 users 与 users_timer
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        close(m_reactors[i].epollfd);
+        close(m_reactors[i].wakeupfd);
+    }
+    // 智能指针与slab_table自动释放 users 与 users_timer
     m_pool_holder_.reset();
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write, 
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model, int reactor_num, int io_backend, int max_request, int zero_copy, int precompress,
+                     int compress_level, int compress_budget, string cache_rules, int http2)
 {
     m_port = port;
     m_user = user;
@@ -43,6 +46,27 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_TRIGMode = trigmode;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_reactor_num = reactor_num > 0 ? reactor_num : 0;
+    m_io_backend = io_backend;
+    m_precompress = precompress;
+    m_cache_rules = cache_rules;
+
+    //超过读缓冲区后请求按分段扩展，上限不低于一个读缓冲区
+    long max_request_bytes = (long)max_request * 1024;
+    http_conn::m_max_request = max_request_bytes > http_conn::READ_BUFFER_SIZE ? max_request_bytes : http_conn::READ_BUFFER_SIZE;
+    http_conn::m_sendfile = (1 == zero_copy);
+    http_conn::m_http2 = (1 == http2);
+    gzip_stream::m_level = compress_level > 9 ? 9 : compress_level;
+    gzip_stream::m_budget_ns = compress_budget > 0 ? compress_budget * 1000000L : 0;
+
+    //io_uring后端由环完成读写，工作线程只负责解析和生成响应（Proactor），且只使用一个环
+    if (1 == m_io_backend)
+    {
+        if (m_actormodel != 0 || m_reactor_num != 0)
+            fprintf(stderr, "io_uring backend: ignoring -a %d -r %d, using Proactor with a single ring\n", m_actormodel, m_reactor_num);
+        m_actormodel = 0;
+        m_reactor_num = 0;
+    }
 }
 
 void WebServer::trig_mode()
@@ -92,13 +116,16 @@ void WebServer::sql_pool()
     m_connPool->init("localhost", m_user, m_passWord, m_databaseName, 3306, m_sql_num, m_close_log);
 
     //初始化数据库读取表
-    users->initmysql_result(m_connPool);
+    load_users(m_connPool, m_close_log);
+
+    //登录、注册的查询在执行器的线程上进行，每个线程执行时占用一个连接
+    sql_executor::get_instance()->init(m_connPool, m_sql_num);
 }
 
 void WebServer::thread_pool()
 {
     //线程池
-    m_pool_holder_ = std::unique_ptr<threadpool<http_conn>>(new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num));
+    m_pool_holder_ = std::unique_ptr<threadpool<http_conn>>(new threadpool<http_conn>(m_actormodel, m_thread_num));
     m_pool = m_pool_holder_.get();
 }
 
@@ -134,7 +161,9 @@ void WebServer::eventListen()
     ret = listen(m_listenfd, 5);
     assert(ret >= 0);
 
-    utils.init(TIMESLOT);
+    //timerfd驱动定时器，按最早的超时时间触发，精度为毫秒
+    int timerfd = utils.init_timerfd();
+    assert(timerfd != -1);
 
     //epoll创建内核事件表
     epoll_event events[MAX_EVENT_NUMBER];
@@ -142,7 +171,6 @@ void WebServer::eventListen()
     assert(m_epollfd != -1);
 
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
-    http_conn::m_epollfd = m_epollfd;
 
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);//创建一对相互连接的 UNIX 域套接字,将 m_pipefd[0] 
     //加入 epoll 的监听集合（epoll_ctl(EPOLL_CTL_ADD)），关注其 “可读事件”,当信号发生时，信号处理函数向 m_pipefd[1] 写入一个字节（如1）
@@ -150,55 +178,119 @@ void WebServer::eventListen()
     assert(ret != -1);
     utils.setnonblocking(m_pipefd[1]);
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    utils.addfd(m_epollfd, m_cq.notifyfd(), false, 0);// 工作线程完成通知
+    utils.addfd(m_epollfd, timerfd, false, 0);
 
     utils.addsig(SIGPIPE, SIG_IGN);// 忽略SIGPIPE信号，忽略此信号，防止写入已关闭的socket导致程序退出
-    utils.addsig(SIGALRM, utils.sig_handler, false);// 设置SIGALRM的信号处理函数，定时器信号，用于触发定时器检查
     utils.addsig(SIGTERM, utils.sig_handler, false);// 设置SIGTERM的信号处理函数，终止信号，用于优雅关闭服务器
 
-    alarm(TIMESLOT);//启动定时器，每隔TIMESLOT时间发送一次SIGNALRM信号,SIGALRM信号的作用是周期性地触发超时检查，确保服务器能够及时关闭那些在指定时间内没有活动的客户端连接，释放资源。
-
     //工具类,信号和描述符基础操作
     Utils::u_pipefd = m_pipefd;
-    Utils::u_epollfd = m_epollfd;
+
+    //io_uring后端：内核不支持（<5.19）时回退到epoll
+    if (1 == m_io_backend)
+    {
+        if (m_uring.init(URING_ENTRIES, MAX_FD, URING_BUF_COUNT, http_conn::READ_BUFFER_SIZE))
+        {
+            http_conn::m_sendfile = false;// 环上用sendmsg发送整批响应，静态文件仍走mmap
+        }
+        else
+        {
+            LOG_ERROR("%s:errno is:%d", "io_uring unavailable, fall back to epoll", errno);
+            m_io_backend = 0;
+        }
+    }
+
+    //缓存策略规则要在预加载之前读入，读取失败时使用内置规则
+    if (!file_cache::get_instance()->load_rules(m_cache_rules.c_str()))
+    {
+        LOG_ERROR("%s:%s", "cannot read cache rules", m_cache_rules.c_str());
+        file_cache::get_instance()->load_rules(nullptr);
+    }
+
+    //静态文件缓存：发送方式确定后再初始化，sendfile缓存打开的fd，否则缓存文件映射；开启预压缩时在这里扫描网站根目录
+    if (!file_cache::get_instance()->init(m_root, !http_conn::m_sendfile, 1 == m_precompress))
+        LOG_ERROR("%s:errno is:%d", "file cache inotify failure", errno);
+
+    //路由表：启动时注册全部路由并编译成前缀树，之后各线程只读
+    init_routes(router::get_instance(), m_close_log);
+
+    //多反应堆模式：主反应堆只负责accept和信号，每个子反应堆各自持有epoll实例并运行在独立线程中
+    if (m_reactor_num > 0)
+    {
+        m_reactors_buf_ = std::unique_ptr<sub_reactor[]>(new sub_reactor[m_reactor_num]);
+        m_reactors = m_reactors_buf_.get();
+        for (int i = 0; i < m_reactor_num; ++i)
+        {
+            sub_reactor *reactor = &m_reactors[i];
+            reactor->epollfd = epoll_create(5);
+            assert(reactor->epollfd != -1);
+            reactor->wakeupfd = eventfd(0, EFD_NONBLOCK);
+            assert(reactor->wakeupfd != -1);
+            int sub_timerfd = reactor->utils.init_timerfd();
+            assert(sub_timerfd != -1);
+            reactor->utils.addfd(reactor->epollfd, reactor->wakeupfd, false, 0);
+            reactor->utils.addfd(reactor->epollfd, reactor->cq.notifyfd(), false, 0);
+            reactor->utils.addfd(reactor->epollfd, sub_timerfd, false, 0);
+            reactor->thread = std::thread([this, reactor]() { this->subReactorLoop(reactor); });
+        }
+    }
 }
 
-void WebServer::timer(int connfd, struct sockaddr_in client_address)
+void WebServer::timer(int connfd, struct sockaddr_in client_address, sub_reactor *reactor)
 {
-    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
+    int epollfd = (1 == m_io_backend) ? -1 : loop_epollfd(reactor);
+    users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, epollfd);
+    users[connfd].m_cq = (1 == m_io_backend) ? &m_uring.posted() : &loop_cq(reactor);
 
     //初始化client_data数据
-    //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
+    //使用client_data中预先分配的定时器节点，设置回调函数和超时时间，绑定用户数据，将定时器挂到时间轮上
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
+    users_timer[connfd].conn = &users[connfd];
+    util_timer *timer = &users_timer[connfd].node;
     timer->user_data = &users_timer[connfd];
-    timer->cb_func = cb_func;
+    timer->cb_func = (1 == m_io_backend) ? uring_cb_func : cb_func;
 
-    //创建定时器并设置超时时间
-    time_t cur = time(nullptr);
-    timer->expire = cur + 3 * TIMESLOT;// 当前时间 + 3个时间槽
+    //创建定时器并设置超时时间，新连接需要在请求头超时内发来请求
+    timer->expire = loop_utils(reactor).m_now + HEADER_TIMEOUT_MS;
     users_timer[connfd].timer = timer;
-    utils.m_timer_lst.add_timer(timer);
+    loop_utils(reactor).m_timer_lst.add_timer(timer);
+    loop_utils(reactor).arm_timer(timer->expire);
 }
 
-//若有数据传输，则将定时器往后延迟3个单位
-//并对新的定时器在链表上的位置进行调整
-void WebServer::adjust_timer(util_timer *timer)
+int WebServer::timeout_ms(http_conn::TIMEOUT_STATE state)
 {
-    time_t cur = time(nullptr);
-    timer->expire = cur + 3 * TIMESLOT;// 重置为当前时间 + 3个时间槽
-    utils.m_timer_lst.adjust_timer(timer);
+    switch (state)
+    {
+    case http_conn::TIMEOUT_BODY:
+        return BODY_TIMEOUT_MS;
+    case http_conn::TIMEOUT_KEEPALIVE:
+        return KEEPALIVE_TIMEOUT_MS;
+    case http_conn::TIMEOUT_WRITE:
+        return WRITE_TIMEOUT_MS;
+    case http_conn::TIMEOUT_PENDING:
+        return PENDING_TIMEOUT_MS;
+    default:
+        return HEADER_TIMEOUT_MS;
+    }
+}
 
-    LOG_INFO("%s", "adjust timer once");
+//若有数据传输，则按连接所处阶段刷新超时时间，时间取本轮事件循环缓存的时钟
+//超时推迟时时间轮不做任何调整，只有超时提前时才移动节点并重设timerfd
+void WebServer::adjust_timer(util_timer *timer, http_conn::TIMEOUT_STATE state, sub_reactor *reactor)
+{
+    Utils &loop = loop_utils(reactor);
+    loop.m_timer_lst.refresh_timer(timer, loop.m_now + timeout_ms(state));
+    loop.arm_timer(timer->expire);
 }
 
-void WebServer::deal_timer(util_timer *timer, int sockfd)
+void WebServer::deal_timer(util_timer *timer, int sockfd, sub_reactor *reactor)
 {
+    if (!timer)//连接已经关闭
+        return;
     timer->cb_func(&users_timer[sockfd]);
-    if (timer)
-    {
-        utils.m_timer_lst.del_timer(timer);
-    }
+    loop_utils(reactor).m_timer_lst.del_timer(timer);
 
     LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
 }
@@ -221,7 +313,10 @@ bool WebServer::dealclientdata()
             LOG_ERROR("%s", "Internal server busy");
             return false;
         }
-        timer(connfd, client_address);
+        if (m_reactor_num > 0)
+            dispatch_conn(connfd, client_address);
+        else
+            timer(connfd, client_address);
     }
 
     else
@@ -240,14 +335,47 @@ bool WebServer::dealclientdata()
                 LOG_ERROR("%s", "Internal server busy");
                 break;
             }
-            timer(connfd, client_address);
+            if (m_reactor_num > 0)
+                dispatch_conn(connfd, client_address);
+            else
+                timer(connfd, client_address);
         }
         return false;
     }
     return true;
 }
 
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
+//按轮询方式选择子反应堆，将连接放入其待接管队列并通过eventfd唤醒
+void WebServer::dispatch_conn(int connfd, struct sockaddr_in client_address)
+{
+    sub_reactor *reactor = &m_reactors[m_next_reactor];
+    m_next_reactor = (m_next_reactor + 1) % m_reactor_num;
+
+    reactor->pending_lock.lock();
+    reactor->pending.push_back(std::make_pair(connfd, client_address));
+    reactor->pending_lock.unlock();
+
+    eventfd_write(reactor->wakeupfd, 1);
+}
+
+//子反应堆被唤醒后，取出全部待接管连接，在自己的epoll实例和定时器容器上完成初始化
+void WebServer::dealwithnewconn(sub_reactor *reactor)
+{
+    eventfd_t count;
+    eventfd_read(reactor->wakeupfd, &count);
+
+    std::list<std::pair<int, sockaddr_in>> conns;
+    reactor->pending_lock.lock();
+    conns.swap(reactor->pending);
+    reactor->pending_lock.unlock();
+
+    for (auto &conn : conns)
+    {
+        timer(conn.first, conn.second, reactor);
+    }
+}
+
+bool WebServer::dealwithsignal(bool &stop_server)
 {
     int ret = 0;
     int sig;
@@ -267,11 +395,6 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
         {
             switch (signals[i])//根据信号类型设置相应标志
             {
-            case SIGALRM:
-            {
-                timeout = true;
-                break;
-            }
             case SIGTERM:
             {
                 stop_server = true;
@@ -283,34 +406,21 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
     return true;
 }
 
-void WebServer::dealwithread(int sockfd)
+void WebServer::dealwithread(int sockfd, sub_reactor *reactor)
 {
     util_timer *timer = users_timer[sockfd].timer;
 
     //reactor
     if (1 == m_actormodel)
     {
+        //数据尚未读入，先按读取请求计时，工作线程完成后再按实际阶段调整
         if (timer)
         {
-            adjust_timer(timer);
+            adjust_timer(timer, http_conn::TIMEOUT_HEADER, reactor);
         }
 
-        //若监测到读事件，将该事件放入请求队列
-        m_pool->append(users + sockfd, 0);// 读任务
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)// 检查工作线程是否处理完成
-            {
-                if (1 == users[sockfd].timer_flag)// 检查是否需要关闭连接
-                {
-                    deal_timer(timer, sockfd);// 处理定时器（关闭连接）
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        //若监测到读事件，将该事件放入请求队列，工作线程处理完后经完成队列通知本循环
+        m_pool->append(&users[sockfd], 0);// 读任务
     }
     else
     {
@@ -319,22 +429,23 @@ void WebServer::dealwithread(int sockfd)
         {
             LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
-            //若监测到读事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);// Proactor模式处理任务
-
+            //交给线程池之前按读入的数据调整定时器，交出之后解析状态属于工作线程，处理完再经完成队列调整
             if (timer)
             {
-                adjust_timer(timer);
+                adjust_timer(timer, users[sockfd].timeout_state(), reactor);
             }
+
+            //若监测到读事件，将该事件放入请求队列
+            m_pool->append_p(&users[sockfd]);// Proactor模式处理任务
         }
         else
         {
-            deal_timer(timer, sockfd);
+            deal_timer(timer, sockfd, reactor);
         }
     }
 }
 
-void WebServer::dealwithwrite(int sockfd)
+void WebServer::dealwithwrite(int sockfd, sub_reactor *reactor)
 {
     util_timer *timer = users_timer[sockfd].timer;
     //reactor
@@ -342,52 +453,96 @@ void WebServer::dealwithwrite(int sockfd)
     {
         if (timer)
         {
-            adjust_timer(timer);
+            adjust_timer(timer, http_conn::TIMEOUT_WRITE, reactor);
         }
 
-        m_pool->append(users + sockfd, 1);// 写任务
-
-        while (true)
-        {
-            if (1 == users[sockfd].improv)
-            {
-                if (1 == users[sockfd].timer_flag)
-                {
-                    deal_timer(timer, sockfd);
-                    users[sockfd].timer_flag = 0;
-                }
-                users[sockfd].improv = 0;
-                break;
-            }
-        }
+        m_pool->append(&users[sockfd], 1);// 写任务
     }
     else
     {
         //proactor
-        if (users[sockfd].write())
+        //上一批响应已发送完，读缓冲区中还有流水线请求，不必等待读事件，直接交给线程池解析
+        if (users[sockfd].has_pending_request())
+        {
+            if (timer)
+            {
+                adjust_timer(timer, http_conn::TIMEOUT_HEADER, reactor);
+            }
+            m_pool->append_p(&users[sockfd]);
+            return;
+        }
+        //与完成通知一样先调整定时器再重新注册事件
+        http_conn::t_rearm_ev = 0;
+        bool ok = users[sockfd].write();
+        int ev = http_conn::t_rearm_ev;
+        http_conn::t_rearm_ev = -1;
+        if (ok)
         {
             LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
+            //未发完为发送阶段，发完后长连接进入空闲阶段
             if (timer)
             {
-                adjust_timer(timer);
+                adjust_timer(timer, users[sockfd].timeout_state(), reactor);
             }
+            if (ev)
+                users[sockfd].rearm(ev);
         }
         else
         {
-            deal_timer(timer, sockfd);
+            deal_timer(timer, sockfd, reactor);
+        }
+    }
+}
+
+//工作线程处理完后投递 (fd, 事件, 连接所处阶段, 代数)，事件循环不再忙等，被eventfd唤醒后统一处理：
+//连接在工作线程处理期间已被关闭的投递丢弃，需要关闭的连接在连接所属的循环中关闭，其余按阶段调整定时器后重新注册事件
+void WebServer::dealwithcompletion(sub_reactor *reactor)
+{
+    std::list<completion> done;
+    if (!loop_cq(reactor).take(done))
+        return;
+
+    for (auto &item : done)
+    {
+        int sockfd = item.fd;
+        if (sockfd < 0)
+            continue;
+        if (item.generation != users[sockfd].generation())// 连接在处理期间已关闭，fd可能已属于新连接
+        {
+            users[sockfd].release_closed();
+            continue;
+        }
+        util_timer *timer = users_timer[sockfd].timer;
+        if (!timer)// 连接已被定时器关闭
+            continue;
+        if (item.state < 0)
+        {
+            deal_timer(timer, sockfd, reactor);// 处理定时器（关闭连接）
+            continue;
         }
+        //先调整定时器再重新注册事件：注册之后连接可能立即被另一个工作线程处理
+        adjust_timer(timer, (http_conn::TIMEOUT_STATE)item.state, reactor);
+        if (item.ev)
+            users[sockfd].rearm(item.ev);
     }
 }
 
 void WebServer::eventLoop()
 {
+    if (1 == m_io_backend)
+    {
+        uringLoop();
+        return;
+    }
+
     bool timeout = false;
     bool stop_server = false;
 
     while (!stop_server)
     {
         int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        utils.refresh_clock();
         if (number < 0 && errno != EINTR)
         {
             LOG_ERROR("%s", "epoll failure");
@@ -414,10 +569,20 @@ void WebServer::eventLoop()
             //处理信号
             else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
             {
-                bool flag = dealwithsignal(timeout, stop_server);
+                bool flag = dealwithsignal(stop_server);
                 if (false == flag)
                     LOG_ERROR("%s", "dealclientdata failure");
             }
+            //timerfd到期，在本轮I/O事件处理完后再处理超时连接
+            else if (sockfd == utils.m_timerfd)
+            {
+                timeout = true;
+            }
+            //处理工作线程的完成通知
+            else if (sockfd == m_cq.notifyfd())
+            {
+                dealwithcompletion();
+            }
             //处理客户连接上接收到的数据
             else if (events[i].events & EPOLLIN)
             {
@@ -437,4 +602,297 @@ void WebServer::eventLoop()
             timeout = false;
         }
     }
+
+    //通知并等待子反应堆退出
+    m_stop = true;
+    for (int i = 0; i < m_reactor_num; ++i)
+    {
+        eventfd_write(m_reactors[i].wakeupfd, 1);
+        if (m_reactors[i].thread.joinable())
+            m_reactors[i].thread.join();
+    }
+}
+
+//子反应堆只处理主反应堆投递过来的连接，定时器由子反应堆自己的timerfd驱动
+void WebServer::subReactorLoop(sub_reactor *reactor)
+{
+    while (!m_stop)
+    {
+        bool timeout = false;
+        int number = epoll_wait(reactor->epollfd, reactor->events, MAX_EVENT_NUMBER, -1);
+        reactor->utils.refresh_clock();
+        if (number < 0 && errno != EINTR)
+        {
+            LOG_ERROR("%s", "sub reactor epoll failure");
+            break;
+        }
+
+        for (int i = 0; i < number; i++)
+        {
+            int sockfd = reactor->events[i].data.fd;
+
+            //接管主反应堆投递的新连接
+            if (sockfd == reactor->wakeupfd)
+            {
+                dealwithnewconn(reactor);
+            }
+            else if (sockfd == reactor->cq.notifyfd())
+            {
+                dealwithcompletion(reactor);
+            }
+            else if (sockfd == reactor->utils.m_timerfd)
+            {
+                timeout = true;
+            }
+            else if (reactor->events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                util_timer *timer = users_timer[sockfd].timer;
+                deal_timer(timer, sockfd, reactor);
+            }
+            else if (reactor->events[i].events & EPOLLIN)
+            {
+                dealwithread(sockfd, reactor);
+            }
+            else if (reactor->events[i].events & EPOLLOUT)
+            {
+                dealwithwrite(sockfd, reactor);
+            }
+        }
+
+        if (timeout)
+        {
+            reactor->utils.timer_handler();
+        }
+    }
+}
+
+//io_uring事件循环：accept、信号管道和工作线程通知都只提交一次（multishot），
+//连接上的recv与sendmsg按EPOLLONESHOT的语义逐次提交，保证同一连接同时只有一个线程在处理
+void WebServer::uringLoop()
+{
+    bool timeout = false;
+    bool stop_server = false;
+
+    m_uring.prep_accept(m_listenfd);
+    m_uring.prep_poll(m_pipefd[0], uring_loop::OP_SIGNAL);
+    m_uring.prep_poll(m_uring.notifyfd(), uring_loop::OP_NOTIFY);
+    m_uring.prep_poll(utils.m_timerfd, uring_loop::OP_TIMER);
+
+    while (!stop_server)
+    {
+        if (m_uring.submit_and_wait() < 0 && errno != EINTR)
+        {
+            LOG_ERROR("%s", "io_uring failure");
+            break;
+        }
+        utils.refresh_clock();
+
+        struct io_uring_cqe cqe;
+        while (m_uring.peek(&cqe))
+        {
+            switch (uring_loop::op_type(cqe.user_data))
+            {
+            case uring_loop::OP_ACCEPT:
+            {
+                uring_accept(cqe);
+                break;
+            }
+            case uring_loop::OP_RECV:
+            {
+                uring_recv(cqe);
+                break;
+            }
+            case uring_loop::OP_SEND:
+            {
+                uring_send(cqe);
+                break;
+            }
+            case uring_loop::OP_SIGNAL:
+            {
+                if (false == dealwithsignal(stop_server))
+                    LOG_ERROR("%s", "dealclientdata failure");
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                    m_uring.prep_poll(m_pipefd[0], uring_loop::OP_SIGNAL);
+                break;
+            }
+            case uring_loop::OP_NOTIFY:
+            {
+                uring_posted();
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                    m_uring.prep_poll(m_uring.notifyfd(), uring_loop::OP_NOTIFY);
+                break;
+            }
+            case uring_loop::OP_TIMER:
+            {
+                timeout = true;
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                    m_uring.prep_poll(utils.m_timerfd, uring_loop::OP_TIMER);
+                break;
+            }
+            }
+        }
+
+        if (timeout)
+        {
+            utils.timer_handler();
+
+            LOG_INFO("%s", "timer tick");
+
+            timeout = false;
+        }
+    }
+}
+
+void WebServer::uring_accept(const struct io_uring_cqe &cqe)
+{
+    //multishot accept 被内核终止（如队列溢出）时需要重新提交
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        m_uring.prep_accept(m_listenfd);
+
+    int connfd = cqe.res;
+    if (connfd < 0)
+    {
+        LOG_ERROR("%s:errno is:%d", "accept error", -connfd);
+        return;
+    }
+    if (http_conn::m_user_count >= MAX_FD)
+    {
+        utils.show_error(connfd, "Internal server busy");
+        LOG_ERROR("%s", "Internal server busy");
+        return;
+    }
+
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+    getpeername(connfd, (struct sockaddr *)&client_address, &client_addrlength);
+    timer(connfd, client_address);
+    m_uring.prep_recv(connfd);
+}
+
+void WebServer::uring_recv(const struct io_uring_cqe &cqe)
+{
+    int sockfd = uring_loop::op_fd(cqe.user_data);
+    int bid = -1;
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+        bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+    //fd已关闭或被新连接复用，只归还缓冲区
+    if (m_uring.is_stale(cqe.user_data))
+    {
+        if (bid >= 0)
+            m_uring.recycle(bid);
+        return;
+    }
+
+    //provided buffer暂时用尽或被信号打断不是连接的错误，重新提交recv；只有对端关闭与真正的错误才关闭连接
+    if (cqe.res == -ENOBUFS || cqe.res == -EINTR || cqe.res == -EAGAIN)
+    {
+        if (bid >= 0)
+            m_uring.recycle(bid);
+        m_uring.prep_recv(sockfd);
+        return;
+    }
+
+    util_timer *timer = users_timer[sockfd].timer;
+    bool ok = cqe.res > 0 && bid >= 0 && users[sockfd].append_input(m_uring.buffer(bid), cqe.res);
+    if (bid >= 0)
+        m_uring.recycle(bid);
+
+    if (ok)
+    {
+        LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+
+        //交出之前调整定时器，交出之后解析状态属于工作线程
+        if (timer)
+        {
+            adjust_timer(timer, users[sockfd].timeout_state());
+        }
+
+        //数据已在读缓冲区中，交给线程池解析并生成响应
+        m_pool->append_p(&users[sockfd]);
+    }
+    else
+    {
+        deal_timer(timer, sockfd);
+    }
+}
+
+void WebServer::uring_send(const struct io_uring_cqe &cqe)
+{
+    int sockfd = uring_loop::op_fd(cqe.user_data);
+    if (m_uring.is_stale(cqe.user_data))
+        return;
+
+    util_timer *timer = users_timer[sockfd].timer;
+    if (cqe.res < 0)
+    {
+        users[sockfd].finish_output();
+        deal_timer(timer, sockfd);
+        return;
+    }
+
+    //部分发送，从剩余位置继续提交
+    if (users[sockfd].consume_output(cqe.res) > 0)
+    {
+        m_uring.prep_send(sockfd, users[sockfd].pending_output());
+        return;
+    }
+
+    LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+    if (users[sockfd].finish_output())
+    {
+        if (timer)
+        {
+            adjust_timer(timer, http_conn::TIMEOUT_KEEPALIVE);
+        }
+        //读缓冲区中还有因批次已满而未解析的流水线请求，直接交给线程池，否则继续接收
+        if (users[sockfd].has_pending_request())
+            m_pool->append_p(&users[sockfd]);
+        else
+            m_uring.prep_recv(sockfd);
+    }
+    else
+    {
+        deal_timer(timer, sockfd);
+    }
+}
+
+void WebServer::uring_posted()
+{
+    std::list<completion> posted;
+    if (!m_uring.take_posted(posted))
+        return;
+
+    //与CQE的is_stale一样按代数丢弃过期的投递：工作线程处理期间连接被定时器关闭、fd又被multishot accept复用时，
+    //过期的投递不能为新连接再提交recv/send或交给线程池
+    for (auto &item : posted)
+    {
+        int sockfd = item.fd;
+        if (sockfd < 0)
+            continue;
+        if (item.generation != users[sockfd].generation())
+        {
+            users[sockfd].release_closed();
+            continue;
+        }
+        util_timer *timer = users_timer[sockfd].timer;
+        if (item.state < 0)
+        {
+            deal_timer(timer, sockfd);
+            continue;
+        }
+        if (timer)
+        {
+            adjust_timer(timer, (http_conn::TIMEOUT_STATE)item.state);
+        }
+        if (!item.ev)// 请求已挂起，等待resume
+            continue;
+        //挂起的请求得到了结果，交给线程池继续处理
+        if (item.ev == EPOLLOUT && users[sockfd].has_pending_request())
+            m_pool->append_p(&users[sockfd]);
+        else if (item.ev == EPOLLOUT)
+            m_uring.prep_send(sockfd, users[sockfd].pending_output());
+        else
+            m_uring.prep_recv(sockfd);
+    }
 }
@@ -12,25 +12,57 @@
 #include <cassert>
 #include <memory>
 #include <string>
+#include <list>
+#include <thread>
+#include <atomic>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./http/http_routes.h"
+#include "./CGImysql/sql_executor.h"
+#include "./uring/uring_loop.h"
+#include "./mempool/slab_table.h"
 
 constexpr int MAX_FD = 65536;           //最大文件描述符
 constexpr int MAX_EVENT_NUMBER = 10000; //最大事件数
-constexpr int TIMESLOT = 5;             //最小超时单位
-static_assert(MAX_FD > 0 && MAX_EVENT_NUMBER > 0 && TIMESLOT > 0, "Constants must be positive");
+constexpr int HEADER_TIMEOUT_MS = 10000;   //读取请求行和头部的超时（毫秒），新连接也按此计时
+constexpr int BODY_TIMEOUT_MS = 15000;     //读取请求体的超时（毫秒）
+constexpr int KEEPALIVE_TIMEOUT_MS = 5000; //长连接空闲等待下一个请求的超时（毫秒）
+constexpr int WRITE_TIMEOUT_MS = 15000;    //响应发送停滞的超时（毫秒）
+constexpr int PENDING_TIMEOUT_MS = 15000;  //请求挂起等待数据库查询结果的超时（毫秒）
+constexpr unsigned URING_ENTRIES = 4096;  //io_uring提交队列长度
+constexpr unsigned URING_BUF_COUNT = 1024;//io_uring provided buffer数量（2的幂）
+static_assert(MAX_FD > 0 && MAX_EVENT_NUMBER > 0 && HEADER_TIMEOUT_MS > 0 && BODY_TIMEOUT_MS > 0 &&
+              KEEPALIVE_TIMEOUT_MS > 0 && WRITE_TIMEOUT_MS > 0 && PENDING_TIMEOUT_MS > 0, "Constants must be positive");
+
+//子反应堆：每个子反应堆运行在独立线程中，拥有自己的epoll实例、事件数组和定时器容器，
+//主反应堆accept新连接后按轮询方式投递到某个子反应堆，此后该连接的读写与超时都只由这个子反应堆处理
+struct sub_reactor
+{
+    sub_reactor() : epollfd(-1), wakeupfd(-1) {}
+
+    int epollfd;// 子反应堆的epoll实例
+    int wakeupfd;// eventfd，主反应堆投递新连接后用于唤醒子反应堆
+    completion_queue cq;// Reactor模式下工作线程处理完读写后的完成通知
+    Utils utils;// 子反应堆自己的定时器容器和timerfd
+    epoll_event events[MAX_EVENT_NUMBER];// 子反应堆的epoll事件数组
+    locker pending_lock;// 保护待接管连接队列
+    std::list<std::pair<int, sockaddr_in>> pending;// 主反应堆已accept、等待子反应堆接管的连接
+    std::thread thread;// 子反应堆线程
+};
 
 class WebServer
 {
 public:
-    WebServer();//构造函数：初始化 HTTP 连接数组、设置根目录路径、创建定时器数组
+    WebServer();//构造函数：创建按需分配的连接表、设置根目录路径
     ~WebServer();//析构函数：清理资源，关闭文件描述符，释放内存
 
     void init(int port , string user, string passWord, string databaseName,
               int log_write , int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);//初始化服务器配置参数
+              int thread_num, int close_log, int actor_model, int reactor_num, int io_backend, int max_request, int zero_copy, int precompress,
+              int compress_level, int compress_budget, string cache_rules, int http2);//初始化服务器配置参数
     
     //组件初始化函数
     void thread_pool();// 初始化线程池
@@ -39,15 +71,26 @@ public:
     void trig_mode();// 设置触发模式
     void eventListen();// 初始化事件监听
     void eventLoop();// 事件循环
+    void subReactorLoop(sub_reactor *reactor);// 子反应堆事件循环
+    void uringLoop();// io_uring后端的事件循环
 
-    //连接管理函数
-    void timer(int connfd, struct sockaddr_in client_address);// 为新连接创建定时器，还包括绑定文件描述符和将fd挂到epoll树上、初始化新连接
-    void adjust_timer(util_timer *timer);// 调整定时器时间
-    void deal_timer(util_timer *timer, int sockfd);// 处理定时器超时
+    //连接管理函数，reactor为空表示连接由主反应堆处理
+    void timer(int connfd, struct sockaddr_in client_address, sub_reactor *reactor = nullptr);// 为新连接创建定时器，还包括绑定文件描述符和将fd挂到epoll树上、初始化新连接
+    void adjust_timer(util_timer *timer, http_conn::TIMEOUT_STATE state, sub_reactor *reactor = nullptr);// 按连接所处阶段调整定时器时间
+    void deal_timer(util_timer *timer, int sockfd, sub_reactor *reactor = nullptr);// 处理定时器超时
     bool dealclientdata();// 处理新客户端连接
-    bool dealwithsignal(bool& timeout, bool& stop_server);// 处理信号
-    void dealwithread(int sockfd);// 处理读事件
-    void dealwithwrite(int sockfd);// 处理写事件
+    void dispatch_conn(int connfd, struct sockaddr_in client_address);// 将新连接投递给子反应堆
+    void dealwithnewconn(sub_reactor *reactor);// 子反应堆接管主反应堆投递的连接
+    bool dealwithsignal(bool& stop_server);// 处理信号
+    void dealwithread(int sockfd, sub_reactor *reactor = nullptr);// 处理读事件
+    void dealwithwrite(int sockfd, sub_reactor *reactor = nullptr);// 处理写事件
+    void dealwithcompletion(sub_reactor *reactor = nullptr);// 处理工作线程的完成通知（epoll后端，io_uring后端见uring_posted）
+
+    //io_uring后端的完成事件处理
+    void uring_accept(const struct io_uring_cqe &cqe);// 处理multishot accept产生的新连接
+    void uring_recv(const struct io_uring_cqe &cqe);// 处理recv完成，数据交给线程池解析
+    void uring_send(const struct io_uring_cqe &cqe);// 处理sendmsg完成，续发或结束本次响应
+    void uring_posted();// 处理工作线程投递的重新提交请求
 
 public:
     //基础配置
@@ -56,11 +99,16 @@ public:
     int m_log_write;// 日志写入方式（0-同步，1-异步）
     int m_close_log;// 是否关闭日志（0-不关闭，1-关闭）
     int m_actormodel;// 并发模型（0-Proactor，1-Reacto）
+    int m_reactor_num;// 子反应堆数量（0-单反应堆，所有事件都在主循环处理）
+    int m_io_backend;// I/O后端（0-epoll，1-io_uring，内核不支持时回退到epoll）
+    int m_precompress;// 启动时预压缩静态文件（0-关闭，1-开启）
+    string m_cache_rules;// 静态文件缓存策略规则文件，为空时使用内置规则
 
     //网络相关
     int m_pipefd[2];// 管道文件描述符，用于统一事件源
     int m_epollfd;// epoll树根实例文件描述符
-    http_conn *users;// HTTP 连接数组，每个元素对应一个客户端连接
+    completion_queue m_cq;// 主反应堆的完成队列，工作线程处理完后通知主循环
+    slab_table<http_conn> users;// 按fd索引的HTTP连接，fd第一次接收连接时才从slab中分配
 
     //数据库相关
     connection_pool *m_connPool;// 数据库连接池指针
@@ -83,13 +131,25 @@ public:
     int m_CONNTrigmode;// connfd触发模式
 
     //定时器相关
-    client_data *users_timer;// 客户端数据数组，每个元素对应一个连接的定时器信息
+    slab_table<client_data> users_timer;// 按fd索引的客户端数据（含定时器节点），分配方式同users
     Utils utils;// 工具类对象，提供定时器管理和基础操作
+
+    //多反应堆相关
+    sub_reactor *m_reactors;// 子反应堆数组
+    int m_next_reactor;// 下一个接收新连接的子反应堆（轮询）
+    std::atomic<bool> m_stop;// 通知子反应堆退出
+
+    //io_uring相关
+    uring_loop m_uring;// io_uring事件循环
 private:
+    Utils &loop_utils(sub_reactor *reactor) { return reactor ? reactor->utils : utils; }// 连接所属反应堆的定时器容器
+    int loop_epollfd(sub_reactor *reactor) const { return reactor ? reactor->epollfd : m_epollfd; }// 连接所属反应堆的epoll实例
+    completion_queue &loop_cq(sub_reactor *reactor) { return reactor ? reactor->cq : m_cq; }// 连接所属反应堆的完成队列
+    static int timeout_ms(http_conn::TIMEOUT_STATE state);// 各阶段对应的超时时间
+
     // 仅用于内存安全所有权管理，不改变对外接口
-    std::unique_ptr<http_conn[]> users_buf_;// HTTP 连接数组，每个元素对应一个客户端连接
-    std::unique_ptr<client_data[]> users_timer_buf_;// 客户端数据数组，每个元素对应一个连接的定时器信息
     std::unique_ptr<threadpool<http_conn>> m_pool_holder_;// 线程池指针
+    std::unique_ptr<sub_reactor[]> m_reactors_buf_;// 子反应堆数组
     std::string m_root_storage_;// 网站根目录路径
 };
 #endif